@@ -0,0 +1,140 @@
+#include "benchmark_client.hh"
+#include "channel.hh"
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+BenchmarkClient::BenchmarkClient(const sockaddr_un &address)
+  : address(address), output_buffer(MessageBufferSize), input_buffer(MessageBufferSize) {}
+
+BenchmarkClient::~BenchmarkClient() {
+  if (this->channel != nullptr) {
+    Channel::unmap(this->channel);
+    close(this->channel_socket);
+  }
+}
+
+auto BenchmarkClient::attach() -> bool {
+  int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_fd == -1) {
+    return false;
+  }
+  auto *const message = this->output_message();
+  message->type       = Message::Type::Attach;
+  message->flags      = 0;
+  iovec  iov{this->input_buffer.data(), sizeof(Message)};
+  msghdr header{};
+  alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))]{};
+  header.msg_iov        = &iov;
+  header.msg_iovlen     = 1;
+  header.msg_control    = control;
+  header.msg_controllen = sizeof(control);
+  int memfd             = -1;
+  if (connect(socket_fd, reinterpret_cast<const sockaddr *>(&this->address), sizeof(this->address)) == 0
+      && send(socket_fd, message, sizeof(Message), MSG_NOSIGNAL) == sizeof(Message)
+      && recvmsg(socket_fd, &header, MSG_WAITALL | MSG_CMSG_CLOEXEC) == sizeof(Message)) {
+    const auto *const rights = CMSG_FIRSTHDR(&header);
+    if (rights != nullptr && rights->cmsg_type == SCM_RIGHTS && rights->cmsg_len == CMSG_LEN(sizeof(memfd))) {
+      memcpy(&memfd, CMSG_DATA(rights), sizeof(memfd));
+    }
+  }
+  if (memfd != -1 && this->input_message()->type == Message::Type::Ok) {
+    this->channel = Channel::map(memfd);
+  }
+  if (memfd != -1) {
+    close(memfd);
+  }
+  if (this->channel == nullptr) {
+    close(socket_fd);
+    return false;
+  }
+  this->channel_socket = socket_fd;
+  return true;
+}
+
+auto BenchmarkClient::exchange(size_t length) -> bool {
+  if (this->channel != nullptr) {
+    const auto seen = this->channel->reply.sequence.load(std::memory_order_acquire);
+    memcpy(this->channel->request.data, this->output_buffer.data(), length);
+    this->channel->request.post(length);
+    // a server gone is not looked for, the benchmark is over by then anyway
+    while (!this->channel->reply.wait(seen)) {
+    }
+    const auto reply = std::min<size_t>(this->channel->reply.length, MessageBufferSize);
+    memcpy(this->input_buffer.data(), this->channel->reply.data, reply);
+    return true;
+  }
+  int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_fd == -1) {
+    return false;
+  }
+  bool result = false;
+  do {
+    if (connect(socket_fd, reinterpret_cast<const sockaddr *>(&this->address), sizeof(this->address)) == -1) {
+      break;
+    }
+    if (send(socket_fd, this->output_buffer.data(), length, MSG_NOSIGNAL) != static_cast<ssize_t>(length)) {
+      break;
+    }
+    MessageReceiver receiver(socket_fd, this->input_message());
+    result = receiver.receive();
+  } while (false);
+  close(socket_fd);
+  return result;
+}
+
+auto BenchmarkClient::ping(size_t length) -> bool {
+  if (sizeof(Message) + sizeof(SingleEntryBody) + length > MessageBufferSize) {
+    return false;
+  }
+  auto *const message = this->output_message();
+  message->type       = Message::Type::Ping;
+  message->flags      = 0;
+  auto *const body    = reinterpret_cast<SingleEntryBody *>(message->data);
+  body->length        = length;
+  memset(body->data, 0x5a, length);
+  return this->exchange(sizeof(Message) + sizeof(SingleEntryBody) + length);
+}
+
+auto BenchmarkClient::query(std::string_view key, uint8_t flags) -> bool {
+  if (sizeof(Message) + sizeof(SingleEntryBody) + key.size() > MessageBufferSize) {
+    return false;
+  }
+  auto *const message = this->output_message();
+  message->type       = Message::Type::Query;
+  message->flags      = flags;
+  auto *const body    = reinterpret_cast<SingleEntryBody *>(message->data);
+  body->length        = key.size();
+  memcpy(body->data, key.data(), key.size());
+  return this->exchange(sizeof(Message) + sizeof(SingleEntryBody) + key.size());
+}
+
+auto BenchmarkClient::add(std::string_view key, std::string_view value, uint8_t flags) -> bool {
+  if (sizeof(Message) + sizeof(DoubleEntryBody) + key.size() + value.size() > MessageBufferSize) {
+    return false;
+  }
+  auto *const message = this->output_message();
+  message->type       = Message::Type::Add;
+  message->flags      = flags;
+  auto *const body    = reinterpret_cast<DoubleEntryBody *>(message->data);
+  body->length[0]     = key.size();
+  body->length[1]     = value.size();
+  memcpy(body->data, key.data(), key.size());
+  memcpy(body->data + key.size(), value.data(), value.size());
+  return this->exchange(sizeof(Message) + sizeof(DoubleEntryBody) + key.size() + value.size());
+}
+
+auto BenchmarkClient::remove(std::string_view key, uint8_t flags) -> bool {
+  if (sizeof(Message) + sizeof(SingleEntryBody) + key.size() > MessageBufferSize) {
+    return false;
+  }
+  auto *const message = this->output_message();
+  message->type       = Message::Type::Delete;
+  message->flags      = flags;
+  auto *const body    = reinterpret_cast<SingleEntryBody *>(message->data);
+  body->length        = key.size();
+  memcpy(body->data, key.data(), key.size());
+  return this->exchange(sizeof(Message) + sizeof(SingleEntryBody) + key.size());
+}
@@ -0,0 +1,47 @@
+#ifndef BENCHMARK_CLIENT_HH_
+#define BENCHMARK_CLIENT_HH_
+#include "message.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <sys/un.h>
+#include <vector>
+
+// minimal client speaking the wire protocol directly, for load generation
+//  unlike the accessor library it holds no global state, so each thread can own one
+//  payloads used in benchmarks are not secrets, so ordinary memory is used for buffers
+class Channel;
+class BenchmarkClient {
+public:
+  explicit BenchmarkClient(const sockaddr_un &address);
+  BenchmarkClient(const BenchmarkClient &)                     = delete;
+  auto operator=(const BenchmarkClient &) -> BenchmarkClient & = delete;
+  ~BenchmarkClient();
+
+  // take every operation over a channel in shared memory from now on, return false if none was attached
+  auto attach() -> bool;
+
+  // each operation opens a connection just like the accessor library does, unless a channel is attached
+  //  return false if failed to communicate with the server, or without sending anything if the request does
+  //   not fit into a message, the result of the operation is left to failed
+  auto ping(size_t length) -> bool;
+  auto query(std::string_view key, uint8_t flags = 0) -> bool;
+  auto add(std::string_view key, std::string_view value, uint8_t flags = 0) -> bool;
+  auto remove(std::string_view key, uint8_t flags = Message::Flags::Delete_AllowMissing) -> bool;
+  // whether the last operation was replied with Failed
+  [[nodiscard]] auto failed() -> bool { return this->input_message()->type == Message::Type::Failed; }
+
+private:
+  sockaddr_un          address;
+  std::vector<uint8_t> output_buffer;
+  std::vector<uint8_t> input_buffer;
+  Channel             *channel{nullptr};
+  int                  channel_socket{-1};
+
+  auto output_message() -> Message * { return reinterpret_cast<Message *>(this->output_buffer.data()); }
+  auto input_message() -> Message * { return reinterpret_cast<Message *>(this->input_buffer.data()); }
+
+  // send the output message of length, then receive the reply into input message
+  auto exchange(size_t length) -> bool;
+};
+#endif
@@ -38,6 +38,23 @@ PYBIND11_MODULE(secret_storage_accessor, m) {
     "make a randomly generated key that is stored in locked memory page",
     pybind11::arg("length")
   );
+  m.def(
+    "make_secured_keys",
+    [](size_t count, size_t length) -> std::vector<pybind11::memoryview> {
+      std::vector<pybind11::memoryview> result;
+      for (const auto &key : SecretStorageAccessor::make_secured_keys(count, length)) {
+        if (auto view = proxy(key); view.has_value()) {
+          result.push_back(std::move(view.value()));
+        } else {
+          SecretStorageAccessor::release_secured_string(key);
+        }
+      }
+      return result;
+    },
+    "make a number of randomly generated keys of the same length at once, each stored in locked memory page",
+    pybind11::arg("count"),
+    pybind11::arg("length")
+  );
   m.def(
     "encode_string",
     [](pybind11::memoryview string) -> std::optional<pybind11::memoryview> {
@@ -47,6 +64,47 @@ PYBIND11_MODULE(secret_storage_accessor, m) {
     "locked memory, that is what base64.b16encode cannot do.",
     pybind11::arg("string")
   );
+  m.def(
+    "decode_string",
+    [](pybind11::memoryview string) -> pybind11::bytes {
+      return SecretStorageAccessor::decode_string(proxy(std::move(string)));
+    },
+    "hex (base16) decode a string of either case into ordinary memory, empty if it is not a valid encoding",
+    pybind11::arg("string")
+  );
+  m.def(
+    "decode_secured_string",
+    [](pybind11::memoryview string) -> std::optional<pybind11::memoryview> {
+      return proxy(SecretStorageAccessor::decode_secured_string(proxy(std::move(string))));
+    },
+    "hex (base16) decode a string of either case directly into the locked memory, None if it is not a valid "
+    "encoding",
+    pybind11::arg("string")
+  );
+  m.def(
+    "encode_base64",
+    [](pybind11::memoryview string) -> std::optional<pybind11::memoryview> {
+      return proxy(SecretStorageAccessor::encode_base64(proxy(std::move(string))));
+    },
+    "base64 encode a string with padding directly into the locked memory",
+    pybind11::arg("string")
+  );
+  m.def(
+    "decode_base64",
+    [](pybind11::memoryview string) -> pybind11::bytes {
+      return SecretStorageAccessor::decode_base64(proxy(std::move(string)));
+    },
+    "base64 decode a padded string into ordinary memory, empty if it is not a valid encoding",
+    pybind11::arg("string")
+  );
+  m.def(
+    "decode_secured_base64",
+    [](pybind11::memoryview string) -> std::optional<pybind11::memoryview> {
+      return proxy(SecretStorageAccessor::decode_secured_base64(proxy(std::move(string))));
+    },
+    "base64 decode a padded string directly into the locked memory, None if it is not a valid encoding",
+    pybind11::arg("string")
+  );
   m.def(
     "ask_secret",
     [](const char *prompt, const char *retry_prompt = nullptr) -> std::optional<pybind11::memoryview> {
@@ -71,14 +129,19 @@ PYBIND11_MODULE(secret_storage_accessor, m) {
   );
   m.def(
     "submit_secret",
-    [](pybind11::memoryview key, pybind11::memoryview value, bool replace = false) -> bool {
-      return SecretStorageAccessor::submit_secret(proxy(std::move(key)), proxy(std::move(value)), replace);
+    [](pybind11::memoryview key, pybind11::memoryview value, bool replace = false, bool evictable = false)
+      -> bool {
+      return SecretStorageAccessor::submit_secret(
+        proxy(std::move(key)), proxy(std::move(value)), replace, evictable
+      );
     },
-    "set a secret directly to server",
+    "set a secret directly to server. an evictable secret may be evicted by the server to make room for "
+    "others once it runs short of its quotas or locked memory",
     pybind11::arg("key"),
     pybind11::arg("value"),
     pybind11::kw_only(),
-    pybind11::arg("replace") = false
+    pybind11::arg("replace")   = false,
+    pybind11::arg("evictable") = false
   );
   m.def(
     "remove_secret",
@@ -91,6 +154,84 @@ PYBIND11_MODULE(secret_storage_accessor, m) {
     pybind11::arg("allow_missing") = false
   );
   m.def("terminate_server", SecretStorageAccessor::terminate_server, "terminate the server");
+  m.def(
+    "stats",
+    SecretStorageAccessor::stats,
+    "query statistics of the server as human readable text, empty if failed to communicate with the server"
+  );
+  m.def(
+    "list_prefix",
+    [](pybind11::memoryview prefix) -> std::vector<pybind11::memoryview> {
+      std::vector<pybind11::memoryview> result;
+      for (const auto &key : SecretStorageAccessor::list_prefix(proxy(std::move(prefix)))) {
+        if (auto view = proxy(key); view.has_value()) {
+          result.push_back(std::move(view.value()));
+        } else {
+          SecretStorageAccessor::release_secured_string(key);
+        }
+      }
+      return result;
+    },
+    "list keys on server that start with prefix, values are never transferred. each key returned is a "
+    "secured string that shall be released",
+    pybind11::arg("prefix")
+  );
+  m.def(
+    "remove_prefix",
+    [](pybind11::memoryview prefix) -> std::optional<size_t> {
+      return SecretStorageAccessor::remove_prefix(proxy(std::move(prefix)));
+    },
+    "delete all secrets on server whose key starts with prefix. return the number of secrets deleted, or "
+    "None if failed to communicate with the server",
+    pybind11::arg("prefix")
+  );
+  m.def(
+    "watch",
+    [](const std::vector<std::string> &keys, const std::vector<std::string> &prefixes) -> int {
+      const std::vector<std::string_view> key_views(keys.begin(), keys.end());
+      const std::vector<std::string_view> prefix_views(prefixes.begin(), prefixes.end());
+      return SecretStorageAccessor::watch(key_views, prefix_views);
+    },
+    "open a connection watching keys, and all keys starting with any of prefixes. return the file descriptor "
+    "of the connection, which can be waited on with select or poll, or -1 if failed",
+    pybind11::arg("keys")     = std::vector<std::string>(),
+    pybind11::arg("prefixes") = std::vector<std::string>()
+  );
+  m.def(
+    "next_event",
+    [](int watch) -> std::optional<std::pair<const char *, pybind11::bytes>> {
+      static constexpr const char *names[] = {"added", "replaced", "deleted", "expired", "evicted"};
+      std::optional<std::pair<SecretStorageAccessor::Event, std::string>> event;
+      {
+        pybind11::gil_scoped_release release;
+        event = SecretStorageAccessor::next_event(watch);
+      }
+      if (!event.has_value()) {
+        return {};
+      }
+      return std::make_pair(names[static_cast<size_t>(event->first)], pybind11::bytes(event->second));
+    },
+    "wait for the next change on a connection opened by watch, as a tuple of the kind of change (added, "
+    "replaced, deleted, expired or evicted) and the key. values are never included. None once the connection "
+    "is closed",
+    pybind11::arg("watch")
+  );
+  m.def(
+    "unwatch",
+    SecretStorageAccessor::unwatch,
+    "stop watching and close the connection",
+    pybind11::arg("watch")
+  );
+  m.def(
+    "attach",
+    SecretStorageAccessor::attach,
+    "send ping, stats and requests on a single key over a channel in shared memory from now on"
+  );
+  m.def(
+    "detach",
+    SecretStorageAccessor::detach,
+    "detach the channel attached, after which every request goes over a connection of its own again"
+  );
   m.def(
     "get_secret",
     [](pybind11::memoryview key, const char *prompt = nullptr, bool update = true, bool remove = false)
@@ -0,0 +1,192 @@
+#include "capture.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string_view>
+#include <sys/random.h>
+#include <unistd.h>
+
+static inline auto rotate(uint64_t value, int bits) -> uint64_t {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline void sip_round(uint64_t *v) {
+  v[0] += v[1];
+  v[1]  = rotate(v[1], 13) ^ v[0];
+  v[0]  = rotate(v[0], 32);
+  v[2] += v[3];
+  v[3]  = rotate(v[3], 16) ^ v[2];
+  v[0] += v[3];
+  v[3]  = rotate(v[3], 21) ^ v[0];
+  v[2] += v[1];
+  v[1]  = rotate(v[1], 17) ^ v[2];
+  v[2]  = rotate(v[2], 32);
+}
+
+// SipHash-2-4 of data under a 128 bit key
+static auto siphash(const uint64_t *key, std::string_view data) -> uint64_t {
+  uint64_t v[4] = {
+    0x736f6d6570736575 ^ key[0],
+    0x646f72616e646f6d ^ key[1],
+    0x6c7967656e657261 ^ key[0],
+    0x7465646279746573 ^ key[1],
+  };
+  const auto compress = [&](uint64_t word, int rounds) {
+    v[3] ^= word;
+    for (int i = 0; i < rounds; i++) {
+      sip_round(v);
+    }
+    v[0] ^= word;
+  };
+  const size_t blocks = data.size() / sizeof(uint64_t);
+  for (size_t i = 0; i < blocks; i++) {
+    uint64_t word;
+    memcpy(&word, data.data() + i * sizeof(word), sizeof(word));
+    compress(word, 2);
+  }
+  // the last word holds the bytes left along with the length in its most significant byte
+  uint64_t last = static_cast<uint64_t>(data.size()) << 56;
+  for (size_t i = blocks * sizeof(uint64_t); i < data.size(); i++) {
+    last |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * (i % sizeof(uint64_t)));
+  }
+  compress(last, 2);
+  v[2] ^= 0xff;
+  for (int i = 0; i < 4; i++) {
+    sip_round(v);
+  }
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+static auto write_all(int fd, const void *data, size_t length) -> bool {
+  const auto *pointer = reinterpret_cast<const uint8_t *>(data);
+  while (length != 0) {
+    const auto written = write(fd, pointer, length);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    pointer += written;
+    length  -= written;
+  }
+  return true;
+}
+
+Capture::Capture(int fd) : fd(fd), hash_key{}, started(std::chrono::steady_clock::now()) {
+  // never grows afterwards, so that recording does not allocate
+  this->pending.reserve(MaxPending);
+}
+
+auto Capture::open(const char *path) -> std::unique_ptr<Capture> {
+  const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return nullptr;
+  }
+  std::unique_ptr<Capture> result(new Capture(fd));
+  const auto               now = std::chrono::system_clock::now().time_since_epoch();
+  Header                   header{};
+  memcpy(header.magic, Magic, sizeof(Magic));
+  header.record_size = sizeof(Record);
+  header.started     = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+  if (getrandom(result->hash_key, sizeof(result->hash_key), 0) != sizeof(result->hash_key)
+      || !write_all(fd, &header, sizeof(header))) {
+    return nullptr;
+  }
+  sigset_t all;
+  sigset_t blocked;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &blocked);
+  result->writer = std::thread(&Capture::write_out, result.get());
+  pthread_sigmask(SIG_SETMASK, &blocked, nullptr);
+  return result;
+}
+
+Capture::~Capture() {
+  if (this->writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->stopping = true;
+    }
+    this->filled.notify_one();
+    this->writer.join();
+  }
+  close(this->fd);
+}
+
+void Capture::record(
+  uint64_t                              connection,
+  std::chrono::steady_clock::time_point begin,
+  const Message                        *request,
+  const Message                        *reply
+) {
+  Record record{};
+  record.time = std::max<int64_t>(
+    0, std::chrono::duration_cast<std::chrono::nanoseconds>(begin - this->started).count()
+  );
+  record.connection = connection;
+  record.type       = request->type;
+  record.flags      = request->flags;
+  record.failed     = reply->type == Message::Type::Failed;
+  std::string_view key;
+  if (request->type == Message::Type::Add) {
+    const auto *const body = reinterpret_cast<const DoubleEntryBody *>(request->data);
+    key                    = {reinterpret_cast<const char *>(body->data), body->length[0]};
+    record.value_size      = body->length[1];
+  } else if (request->type == Message::Type::Query || request->type == Message::Type::Delete
+             || request->type == Message::Type::Watch || request->type == Message::Type::ListPrefix
+             || request->type == Message::Type::DeletePrefix) {
+    const auto *const body = reinterpret_cast<const SingleEntryBody *>(request->data);
+    key                    = {reinterpret_cast<const char *>(body->data), body->length};
+    if (request->type == Message::Type::Query && reply->type == Message::Type::Result) {
+      record.value_size = reinterpret_cast<const SingleEntryBody *>(reply->data)->length;
+    }
+  } else if (request->type == Message::Type::Ping) {
+    record.value_size = reinterpret_cast<const SingleEntryBody *>(request->data)->length;
+  }
+  if (!key.empty()) {
+    record.key      = siphash(this->hash_key, key);
+    record.key_size = key.size();
+  }
+  bool half_full = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->pending.size() >= MaxPending) {
+      this->dropped_records.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    this->pending.push_back(record);
+    half_full = this->pending.size() == MaxPending / 2;
+  }
+  if (half_full) {
+    this->filled.notify_one();
+  }
+}
+
+auto Capture::dropped() const -> uint64_t { return this->dropped_records.load(std::memory_order_relaxed); }
+
+void Capture::write_out() {
+  std::vector<Record> records;
+  records.reserve(MaxPending);
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (true) {
+    this->filled.wait_for(lock, FlushInterval, [this]() {
+      return this->stopping || this->pending.size() >= MaxPending / 2;
+    });
+    // the buffer written out last takes the place of the one filled, so neither ever reallocates
+    records.swap(this->pending);
+    const bool stopping = this->stopping;
+    lock.unlock();
+    if (!records.empty() && !write_all(this->fd, records.data(), records.size() * sizeof(Record))) {
+      this->dropped_records.fetch_add(records.size(), std::memory_order_relaxed);
+    }
+    records.clear();
+    if (stopping) {
+      return;
+    }
+    lock.lock();
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef CAPTURE_HH_
+#define CAPTURE_HH_
+#include "message.hh"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// anonymized trace of the requests served, so that the server can be tuned against the shape of real traffic
+//  without the secrets in it, which secret-storage-replay drives a test server with
+//  only the type, flags and outcome of each request are recorded along with the sizes of its key and value,
+//   a hash of its key, when it arrived and the connection it came over, never a key or a value
+//  keys are hashed with SipHash-2-4 under a key drawn for each capture, so that a hash can neither be told
+//   by hashing guessed keys, nor be matched with the same key in another capture
+//  requests are appended to a buffer under a lock, which a thread of its own swaps and writes out
+//  the file is a header followed by records, both in native byte order
+class Capture final {
+public:
+  static constexpr char Magic[8] = {'S', 'S', 'C', 'A', 'P', 'T', '\0', '\1'};
+
+  struct Header {
+    char     magic[sizeof(Magic)];
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t started; // wall clock time capturing started at, in nanoseconds since the epoch
+  };
+  struct Record {
+    uint64_t time;       // nanoseconds since capturing started
+    uint64_t connection; // connection the request came over, a channel keeps that of the one attaching it
+    uint64_t key;        // hash of the key, 0 if the request has none
+    uint32_t key_size;
+    uint32_t value_size; // size of the value stored or found, or of the payload of a ping
+    uint8_t  type;
+    uint8_t  flags;
+    uint8_t  failed; // whether the request was replied with Failed
+    uint8_t  reserved[5];
+  };
+
+  // records waiting to be written out at most, any more are dropped until the writing thread catches up
+  static constexpr size_t MaxPending    = 1 << 16;
+  // records are written out whenever half as many are waiting, or this long after the last time otherwise
+  static constexpr auto   FlushInterval = std::chrono::seconds(1);
+
+  // start capturing into a new file at path, nullptr if failed
+  //  the writing thread takes no signal, and shall be started after daemonizing as only the calling thread
+  //   survives a fork
+  static auto open(const char *path) -> std::unique_ptr<Capture>;
+  Capture(const Capture &)                     = delete;
+  Capture(Capture &&)                          = delete;
+  auto operator=(const Capture &) -> Capture & = delete;
+  auto operator=(Capture &&) -> Capture      & = delete;
+  // write out every record left and close the file
+  ~Capture();
+
+  // record a request that arrived at begin over a connection, and was replied by reply
+  void record(
+    uint64_t                              connection,
+    std::chrono::steady_clock::time_point begin,
+    const Message                        *request,
+    const Message                        *reply
+  );
+  // records dropped so far as writing them out could not keep up
+  [[nodiscard]] auto dropped() const -> uint64_t;
+
+private:
+  int                                   fd;
+  uint64_t                              hash_key[2];
+  std::chrono::steady_clock::time_point started;
+
+  std::mutex              mutex;
+  std::condition_variable filled;
+  std::vector<Record>     pending;
+  bool                    stopping{false};
+  std::atomic<uint64_t>   dropped_records{0};
+  std::thread             writer;
+
+  explicit Capture(int fd);
+  // write out records swapped out of pending until stopping
+  void write_out();
+};
+#endif
@@ -0,0 +1,87 @@
+#include "channel.hh"
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+// the channel is shared between processes, so the futex operations must not be private ones
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t expected, std::chrono::nanoseconds timeout) {
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  const timespec relative{
+    .tv_sec  = static_cast<time_t>(seconds.count()),
+    .tv_nsec = static_cast<long>((timeout - seconds).count()),
+  };
+  syscall(SYS_futex, word, FUTEX_WAIT, expected, &relative, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+void Channel::Slot::post(uint32_t length) {
+  this->length = length;
+  // either the other side sees the new sequence before sleeping, or it is seen sleeping here
+  this->sequence.fetch_add(1, std::memory_order_seq_cst);
+  if (this->sleeping.load(std::memory_order_seq_cst) != 0) {
+    futex_wake(&this->sequence);
+  }
+}
+
+auto Channel::Slot::wait(uint32_t seen) -> bool {
+  // the other side cannot make progress while this one spins on the only core there is
+  static const auto spin       = std::thread::hardware_concurrency() > 1 ? SpinTime : decltype(SpinTime)(0);
+  const auto        spin_until = std::chrono::steady_clock::now() + spin;
+  while (std::chrono::steady_clock::now() < spin_until) {
+    if (this->sequence.load(std::memory_order_acquire) != seen) {
+      return true;
+    }
+  }
+  this->sleeping.store(1, std::memory_order_seq_cst);
+  if (this->sequence.load(std::memory_order_seq_cst) == seen) {
+    futex_wait(&this->sequence, seen, SleepTime);
+  }
+  this->sleeping.store(0, std::memory_order_relaxed);
+  return this->sequence.load(std::memory_order_acquire) != seen;
+}
+
+auto Channel::create() -> int {
+  const int memfd = memfd_create("secret-storage-channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd == -1) {
+    return -1;
+  }
+  // the client shall not shrink it under the server, which would fault on the pages missing
+  if (ftruncate(memfd, sizeof(Channel)) == -1
+      || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+    close(memfd);
+    return -1;
+  }
+  return memfd;
+}
+
+auto Channel::map(int memfd) -> Channel * {
+  struct stat status;
+  if (fstat(memfd, &status) == -1 || static_cast<size_t>(status.st_size) < sizeof(Channel)) {
+    return nullptr;
+  }
+  void *region = mmap(nullptr, sizeof(Channel), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (region == MAP_FAILED) {
+    return nullptr;
+  }
+  // secrets pass through it like through any other buffer holding them
+  if (mlock(region, sizeof(Channel)) == -1) {
+    munmap(region, sizeof(Channel));
+    return nullptr;
+  }
+  madvise(region, sizeof(Channel), MADV_DONTDUMP);
+  return reinterpret_cast<Channel *>(region);
+}
+
+void Channel::unmap(Channel *channel) {
+  explicit_bzero(channel->request.data, sizeof(channel->request.data));
+  explicit_bzero(channel->reply.data, sizeof(channel->reply.data));
+  munmap(channel, sizeof(Channel));
+}
@@ -0,0 +1,46 @@
+#ifndef CHANNEL_HH_
+#define CHANNEL_HH_
+#include "message.hh"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// a request slot and a reply slot shared by a client and the server in a memfd, so that requests on single
+//  keys are served without a syscall as long as both sides keep up with each other
+//  a side posts a message by bumping the sequence number of its slot, while the other side spins on it for a
+//   while before sleeping on it as a futex, so a syscall is only made to wake up a side that sleeps
+//  a client has at most one request outstanding, so a single slot in each direction makes the whole ring
+//  the memfd is created by the server and passed over the connection attaching it, which is kept open so
+//   that either side notices the other one going away
+class Channel {
+public:
+  // time spent spinning for a message before sleeping, which is what busy sides poll within
+  static constexpr auto SpinTime  = std::chrono::microseconds(50);
+  // longest sleep before waiting returns to let the caller check whether the other side is still there
+  static constexpr auto SleepTime = std::chrono::milliseconds(100);
+
+  struct alignas(64) Slot {
+    // futex word bumped whenever a message is posted
+    std::atomic<uint32_t> sequence;
+    // set while the other side sleeps on sequence, so that posting has to wake it up
+    std::atomic<uint32_t> sleeping;
+    uint32_t              length;
+    uint8_t               data[MessageBufferSize];
+
+    // publish the message of length written into data
+    void post(uint32_t length);
+    // wait until sequence is no longer seen for at most SleepTime, return whether it was bumped
+    [[nodiscard]] auto wait(uint32_t seen) -> bool;
+  };
+  Slot request;
+  Slot reply;
+
+  // create a memfd holding a channel sealed against resizing, -1 if failed
+  static auto create() -> int;
+  // map the channel of a memfd locked and excluded from core dumps, nullptr if failed
+  static auto map(int memfd) -> Channel *;
+  // wipe and unmap a channel mapped
+  static void unmap(Channel *channel);
+};
+#endif
@@ -0,0 +1,277 @@
+#include "codec.hh"
+#include <array>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static constexpr char hex_digits[] = "0123456789ABCDEF";
+static constexpr char base64_digits[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// maps every character to the value it encodes, or to Invalid
+static constexpr uint8_t Invalid = 0xff;
+
+static constexpr auto hex_values = []() {
+  std::array<uint8_t, 256> table{};
+  table.fill(Invalid);
+  for (uint8_t i = 0; i < 16; i++) {
+    table[static_cast<uint8_t>(hex_digits[i])] = i;
+    if (i >= 10) {
+      table[static_cast<uint8_t>(hex_digits[i] - 'A' + 'a')] = i;
+    }
+  }
+  return table;
+}();
+
+static constexpr auto base64_values = []() {
+  std::array<uint8_t, 256> table{};
+  table.fill(Invalid);
+  for (uint8_t i = 0; i < 64; i++) {
+    table[static_cast<uint8_t>(base64_digits[i])] = i;
+  }
+  return table;
+}();
+
+static void hex_encode_scalar(const uint8_t *input, size_t size, char *output) {
+  for (size_t i = 0; i < size; i++) {
+    output[i << 1]       = hex_digits[input[i] >> 4];
+    output[(i << 1) | 1] = hex_digits[input[i] & 0xf];
+  }
+}
+
+static auto hex_decode_scalar(const char *input, size_t size, uint8_t *output) -> bool {
+  // invalid characters are accumulated rather than branched on
+  uint8_t invalid = 0;
+  for (size_t i = 0; i < size; i++) {
+    const auto high = hex_values[static_cast<uint8_t>(input[i << 1])];
+    const auto low  = hex_values[static_cast<uint8_t>(input[(i << 1) | 1])];
+    invalid        |= (high | low) & 0xf0;
+    output[i]       = static_cast<uint8_t>((high << 4) | (low & 0xf));
+  }
+  return invalid == 0;
+}
+
+#if defined(__x86_64__)
+// nibbles are turned into digits by a table lookup with pshufb, then interleaved back into order
+__attribute__((target("ssse3"))) static void
+hex_encode_ssse3(const uint8_t *input, size_t size, char *output) {
+  const auto digits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex_digits));
+  const auto mask   = _mm_set1_epi8(0xf);
+  size_t     i      = 0;
+  for (; i + 16 <= size; i += 16) {
+    const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+    const auto high  = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    const auto low   = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + (i << 1)), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + (i << 1) + 16), _mm_unpackhi_epi8(high, low));
+  }
+  hex_encode_scalar(input + i, size - i, output + (i << 1));
+}
+
+__attribute__((target("avx2"))) static void hex_encode_avx2(const uint8_t *input, size_t size, char *output) {
+  const auto digits =
+    _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex_digits)));
+  const auto mask = _mm256_set1_epi8(0xf);
+  size_t     i    = 0;
+  for (; i + 32 <= size; i += 32) {
+    const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + i));
+    const auto high  = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+    const auto low   = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, mask));
+    // unpacking works within 128 bit lanes, so the halves are swapped back into order afterwards
+    const auto first  = _mm256_unpacklo_epi8(high, low);
+    const auto second = _mm256_unpackhi_epi8(high, low);
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i *>(output + (i << 1)), _mm256_permute2x128_si256(first, second, 0x20)
+    );
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i *>(output + (i << 1) + 32), _mm256_permute2x128_si256(first, second, 0x31)
+    );
+  }
+  hex_encode_ssse3(input + i, size - i, output + (i << 1));
+}
+
+// convert 16 hex digits into their values, clearing valid if any of them is not a hex digit
+//  c - '0' is within [0, 9] only for digits and (c | 0x20) - 'a' is within [0, 5] only for letters of
+//  either case, both as signed bytes
+__attribute__((target("ssse3"))) static inline auto hex_values_ssse3(__m128i characters, __m128i &valid)
+  -> __m128i {
+  const auto digit     = _mm_sub_epi8(characters, _mm_set1_epi8('0'));
+  const auto letter    = _mm_sub_epi8(_mm_or_si128(characters, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  const auto is_digit  = _mm_and_si128(
+    _mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(10), digit)
+  );
+  const auto is_letter = _mm_and_si128(
+    _mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(6), letter)
+  );
+  valid = _mm_and_si128(valid, _mm_or_si128(is_digit, is_letter));
+  return _mm_or_si128(
+    _mm_and_si128(is_digit, digit), _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10)))
+  );
+}
+
+// pairs of nibbles are combined by pmaddubsw as high * 16 + low into 16 bit lanes, then packed into bytes
+__attribute__((target("ssse3"))) static auto hex_decode_ssse3(const char *input, size_t size, uint8_t *output)
+  -> bool {
+  const auto weights = _mm_set1_epi16(0x0110);
+  auto       valid   = _mm_set1_epi8(-1);
+  size_t     i       = 0;
+  for (; i + 16 <= size; i += 16) {
+    const auto first =
+      hex_values_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input + (i << 1))), valid);
+    const auto second =
+      hex_values_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input + (i << 1) + 16)), valid);
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>(output + i),
+      _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights))
+    );
+  }
+  return _mm_movemask_epi8(valid) == 0xffff && hex_decode_scalar(input + (i << 1), size - i, output + i);
+}
+
+__attribute__((target("avx2"))) static inline auto hex_values_avx2(__m256i characters, __m256i &valid)
+  -> __m256i {
+  const auto digit     = _mm256_sub_epi8(characters, _mm256_set1_epi8('0'));
+  const auto letter =
+    _mm256_sub_epi8(_mm256_or_si256(characters, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  const auto is_digit  = _mm256_and_si256(
+    _mm256_cmpgt_epi8(digit, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(10), digit)
+  );
+  const auto is_letter = _mm256_and_si256(
+    _mm256_cmpgt_epi8(letter, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(6), letter)
+  );
+  valid = _mm256_and_si256(valid, _mm256_or_si256(is_digit, is_letter));
+  return _mm256_or_si256(
+    _mm256_and_si256(is_digit, digit),
+    _mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10)))
+  );
+}
+
+__attribute__((target("avx2"))) static auto hex_decode_avx2(const char *input, size_t size, uint8_t *output)
+  -> bool {
+  const auto weights = _mm256_set1_epi16(0x0110);
+  auto       valid   = _mm256_set1_epi8(-1);
+  size_t     i       = 0;
+  for (; i + 32 <= size; i += 32) {
+    const auto first =
+      hex_values_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + (i << 1))), valid);
+    const auto second =
+      hex_values_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + (i << 1) + 32)), valid);
+    // packing works within 128 bit lanes, so the quarters are reordered afterwards
+    const auto packed =
+      _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights), _mm256_maddubs_epi16(second, weights));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+  return static_cast<uint32_t>(_mm256_movemask_epi8(valid)) == 0xffffffff
+      && hex_decode_ssse3(input + (i << 1), size - i, output + i);
+}
+#endif
+
+using HexEncoder = void (*)(const uint8_t *, size_t, char *);
+using HexDecoder = bool (*)(const char *, size_t, uint8_t *);
+
+static auto select_hex_encoder() -> HexEncoder {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return hex_encode_avx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return hex_encode_ssse3;
+  }
+#endif
+  return hex_encode_scalar;
+}
+
+static auto select_hex_decoder() -> HexDecoder {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return hex_decode_avx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return hex_decode_ssse3;
+  }
+#endif
+  return hex_decode_scalar;
+}
+
+void Codec::hex_encode(const uint8_t *input, size_t size, char *output) {
+  static const auto encoder = select_hex_encoder();
+  encoder(input, size, output);
+}
+
+auto Codec::hex_decode(const char *input, size_t size, uint8_t *output) -> bool {
+  static const auto decoder = select_hex_decoder();
+  return decoder(input, size, output);
+}
+
+void Codec::base64_encode(const uint8_t *input, size_t size, char *output) {
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3, output += 4) {
+    const uint32_t group = (input[i] << 16) | (input[i + 1] << 8) | input[i + 2];
+    output[0]            = base64_digits[group >> 18];
+    output[1]            = base64_digits[(group >> 12) & 0x3f];
+    output[2]            = base64_digits[(group >> 6) & 0x3f];
+    output[3]            = base64_digits[group & 0x3f];
+  }
+  if (i == size) {
+    return;
+  }
+  const uint32_t group = (input[i] << 16) | (i + 1 < size ? input[i + 1] << 8 : 0);
+  output[0]            = base64_digits[group >> 18];
+  output[1]            = base64_digits[(group >> 12) & 0x3f];
+  output[2]            = i + 1 < size ? base64_digits[(group >> 6) & 0x3f] : '=';
+  output[3]            = '=';
+}
+
+auto Codec::base64_decoded_size(const char *input, size_t size) -> std::optional<size_t> {
+  if (size % 4 != 0) {
+    return {};
+  }
+  if (size == 0) {
+    return 0;
+  }
+  const size_t padding = input[size - 1] != '=' ? 0 : input[size - 2] != '=' ? 1 : 2;
+  return size / 4 * 3 - padding;
+}
+
+auto Codec::base64_decode(const char *input, size_t size, uint8_t *output) -> bool {
+  const auto decoded_size = base64_decoded_size(input, size);
+  if (!decoded_size.has_value()) {
+    return false;
+  }
+  // invalid characters are accumulated rather than branched on
+  uint8_t invalid = 0;
+  size_t  i       = 0;
+  size_t  j       = 0;
+  for (; j + 3 <= decoded_size.value(); i += 4, j += 3) {
+    const auto a = base64_values[static_cast<uint8_t>(input[i])];
+    const auto b = base64_values[static_cast<uint8_t>(input[i + 1])];
+    const auto c = base64_values[static_cast<uint8_t>(input[i + 2])];
+    const auto d = base64_values[static_cast<uint8_t>(input[i + 3])];
+    invalid      |= a | b | c | d;
+    const uint32_t group = (a << 18) | (b << 12) | (c << 6) | d;
+    output[j]            = static_cast<uint8_t>(group >> 16);
+    output[j + 1]        = static_cast<uint8_t>(group >> 8);
+    output[j + 2]        = static_cast<uint8_t>(group);
+  }
+  if ((invalid & 0xc0) != 0) {
+    return false;
+  }
+  const auto remaining = decoded_size.value() - j;
+  if (remaining == 0) {
+    return true;
+  }
+  // the last group is padded, bits not making up a whole byte must be zero for the encoding to be canonical
+  const auto a = base64_values[static_cast<uint8_t>(input[i])];
+  const auto b = base64_values[static_cast<uint8_t>(input[i + 1])];
+  const auto c = remaining == 2 ? base64_values[static_cast<uint8_t>(input[i + 2])] : 0;
+  if (((a | b | c) & 0xc0) != 0 || (remaining == 1 ? b & 0xf : c & 0x3) != 0) {
+    return false;
+  }
+  output[j] = static_cast<uint8_t>((a << 2) | (b >> 4));
+  if (remaining == 2) {
+    output[j + 1] = static_cast<uint8_t>((b << 4) | (c >> 2));
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#ifndef CODEC_HH_
+#define CODEC_HH_
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// encoders and decoders writing into caller provided memory, so that secrets can be decoded straight into
+//  locked memory
+//  hex kernels are vectorized with SSSE3 or AVX2 when the processor supports them, selected at runtime
+namespace Codec {
+// encode size bytes of input into 2 * size upper case hex digits
+void hex_encode(const uint8_t *input, size_t size, char *output);
+// decode 2 * size hex digits of either case into size bytes of output
+//  return false if input contains anything other than hex digits, in which case output is unspecified
+auto hex_decode(const char *input, size_t size, uint8_t *output) -> bool;
+
+// size of the standard base64 encoding with padding of size bytes
+constexpr auto base64_encoded_size(size_t size) -> size_t { return (size + 2) / 3 * 4; }
+void base64_encode(const uint8_t *input, size_t size, char *output);
+// size of the data encoded by a padded base64 input, or nothing if size and padding are not consistent
+auto base64_decoded_size(const char *input, size_t size) -> std::optional<size_t>;
+// decode a padded base64 input of size characters, output shall hold base64_decoded_size bytes
+//  return false if input is not a valid base64 encoding, in which case output is unspecified
+auto base64_decode(const char *input, size_t size, uint8_t *output) -> bool;
+} // namespace Codec
+#endif
@@ -0,0 +1,106 @@
+#include "cold_tier.hh"
+#include <cstring>
+#include <new>
+#include <openssl/evp.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+auto ColdTier::Mapping::do_allocate(size_t bytes, size_t) -> void * {
+  void *region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  madvise(region, bytes, MADV_DONTDUMP);
+  return region;
+}
+
+void ColdTier::Mapping::do_deallocate(void *address, size_t bytes, size_t) { munmap(address, bytes); }
+
+auto ColdTier::Mapping::do_is_equal(const std::pmr::memory_resource &other) const noexcept -> bool {
+  return this == &other;
+}
+
+auto ColdTier::create() -> std::unique_ptr<ColdTier> {
+  std::unique_ptr<ColdTier> result(new ColdTier());
+  result->key.resize(KeyLength);
+  result->context = EVP_CIPHER_CTX_new();
+  if (result->context == nullptr || getrandom(result->key.data(), KeyLength, 0) != KeyLength) {
+    return nullptr;
+  }
+  // the cipher is set up once and kept, only the key and the nonce are set for each operation
+  const uint8_t zeros[KeyLength]{};
+  if (EVP_CipherInit_ex(result->context, EVP_aes_256_gcm(), nullptr, zeros, nullptr, 1) != 1) {
+    return nullptr;
+  }
+  return result;
+}
+
+void ColdTier::scrub() {
+  // expanding a key of zeros overwrites the key schedule, which costs less than resetting the whole context
+  //  and setting up the cipher again
+  const uint8_t zeros[KeyLength]{};
+  EVP_CipherInit_ex(this->context, nullptr, nullptr, zeros, nullptr, 1);
+}
+
+ColdTier::~ColdTier() { EVP_CIPHER_CTX_free(this->context); }
+
+auto ColdTier::seal(std::string_view key, std::string_view value) -> std::optional<Sealed> {
+  const size_t length = NonceLength + TagLength + value.size();
+  auto *const  data   = static_cast<uint8_t *>(this->pool.allocate(length));
+  // the nonce is the number of values sealed before
+  memset(data, 0, NonceLength);
+  memcpy(data, &this->sealed, sizeof(this->sealed));
+  this->sealed++;
+  auto *const cipher  = data + NonceLength + TagLength;
+  int         written = 0;
+  const bool  sealed =
+    EVP_CipherInit_ex(
+      this->context, nullptr, nullptr, reinterpret_cast<const uint8_t *>(this->key.data()), data, 1
+    ) == 1
+    && EVP_EncryptUpdate(
+         this->context, nullptr, &written, reinterpret_cast<const uint8_t *>(key.data()), key.size()
+       ) == 1
+    && EVP_EncryptUpdate(
+         this->context, cipher, &written, reinterpret_cast<const uint8_t *>(value.data()), value.size()
+       ) == 1
+    && EVP_EncryptFinal_ex(this->context, cipher + written, &written) == 1
+    && EVP_CIPHER_CTX_ctrl(this->context, EVP_CTRL_GCM_GET_TAG, TagLength, data + NonceLength) == 1;
+  this->scrub();
+  if (!sealed) {
+    this->pool.deallocate(data, length);
+    return {};
+  }
+  return Sealed{data, static_cast<uint32_t>(value.size())};
+}
+
+auto ColdTier::unseal(std::string_view key, const Sealed &sealed, char *output) -> bool {
+  uint8_t tag[TagLength];
+  memcpy(tag, sealed.data + NonceLength, TagLength);
+  int        written = 0;
+  const bool opened =
+    EVP_CipherInit_ex(
+      this->context, nullptr, nullptr, reinterpret_cast<const uint8_t *>(this->key.data()), sealed.data, 0
+    ) == 1
+    && EVP_DecryptUpdate(
+         this->context, nullptr, &written, reinterpret_cast<const uint8_t *>(key.data()), key.size()
+       ) == 1
+    && EVP_DecryptUpdate(
+         this->context,
+         reinterpret_cast<uint8_t *>(output),
+         &written,
+         sealed.data + NonceLength + TagLength,
+         sealed.length
+       ) == 1
+    && EVP_CIPHER_CTX_ctrl(this->context, EVP_CTRL_GCM_SET_TAG, TagLength, tag) == 1
+    && EVP_DecryptFinal_ex(this->context, reinterpret_cast<uint8_t *>(output) + written, &written) == 1;
+  this->scrub();
+  if (!opened) {
+    explicit_bzero(output, sealed.length);
+  }
+  return opened;
+}
+
+void ColdTier::release(Sealed &sealed) {
+  this->pool.deallocate(sealed.data, NonceLength + TagLength + sealed.length);
+  sealed = {};
+}
@@ -0,0 +1,68 @@
+#ifndef COLD_TIER_HH_
+#define COLD_TIER_HH_
+#include "hardened_memory_allocator.hh"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+// values sealed with AES-256-GCM into ordinary memory, so that how many secrets a storage holds is not bound
+//  by RLIMIT_MEMLOCK
+//  the key is drawn at random for each tier and only ever rests in locked memory, as the key schedule is
+//   overwritten as soon as a value is sealed or unsealed
+//  sealed values may be swapped out, while they are still excluded from core dumps
+//  each value is authenticated together with the key of its secret, so that sealed values cannot be swapped
+//   between secrets, under a nonce counted up, which never repeats as the key is never used elsewhere
+//  a tier is not meant to be used from several threads at once
+class ColdTier final {
+public:
+  static constexpr size_t KeyLength   = 32;
+  static constexpr size_t NonceLength = 12;
+  static constexpr size_t TagLength   = 16;
+
+  // a value sealed, its nonce and its tag followed by its cipher text
+  struct Sealed {
+    uint8_t *data{nullptr};
+    uint32_t length{0}; // length of the value
+  };
+
+  // create a tier with a key of its own, nullptr if failed
+  static auto create() -> std::unique_ptr<ColdTier>;
+  ColdTier(const ColdTier &)                     = delete;
+  ColdTier(ColdTier &&)                          = delete;
+  auto operator=(const ColdTier &) -> ColdTier & = delete;
+  auto operator=(ColdTier &&) -> ColdTier      & = delete;
+  ~ColdTier();
+
+  // seal the value of the secret of key, nothing if failed
+  //  throws std::bad_alloc if no memory is left for it
+  auto seal(std::string_view key, std::string_view value) -> std::optional<Sealed>;
+  // unseal a value of the secret of key into output, which holds sealed.length bytes, false if it fails to
+  //  authenticate
+  auto unseal(std::string_view key, const Sealed &sealed, char *output) -> bool;
+  void release(Sealed &sealed);
+
+private:
+  // maps memory for sealed values, excluded from core dumps, in chunks as the pool asks for them
+  class Mapping final : public std::pmr::memory_resource {
+  private:
+    auto do_allocate(size_t bytes, size_t alignment) -> void * override;
+    void do_deallocate(void *address, size_t bytes, size_t alignment) override;
+    auto do_is_equal(const std::pmr::memory_resource &other) const noexcept -> bool override;
+  };
+
+  secured_string                         key;
+  uint64_t                               sealed{0};
+  EVP_CIPHER_CTX                        *context{nullptr};
+  Mapping                                mapping;
+  std::pmr::unsynchronized_pool_resource pool{&this->mapping};
+
+  ColdTier() = default;
+  // overwrite the key schedule left in the context
+  void scrub();
+};
+#endif
@@ -4,6 +4,25 @@ CommandLineParser::CommandLineParser() {
   this->add_option("--daemon", CommandLineParser::CommonParsers::true_parser, 0);
   this->add_option("--socket", CommandLineParser::CommonParsers::identity_parser, 1);
   this->add_option("--manual-initialize", CommandLineParser::CommonParsers::true_parser, 0);
+  this->add_option("--snapshot", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--snapshot-keyring", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--metrics-socket", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--policy", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--io-timeout", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--grace-period", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--backlog", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--max-queued", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--max-per-peer", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--reserve-locked", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--reactors", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--quota", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--namespace-quota", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--hot-bytes", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--capture", CommandLineParser::CommonParsers::identity_parser, 1);
+  this->add_option("--standby", CommandLineParser::CommonParsers::true_parser, 0);
+#ifdef Tracing
+  this->add_option("--trace", CommandLineParser::CommonParsers::identity_parser, 1);
+#endif
 }
 void CommandLineParser::help() const {
   std::println("In memory storage to hold secrets                                                          ");
@@ -15,8 +34,102 @@ void CommandLineParser::help() const {
   std::println("  --socket              Specify the path to create socket for communication with clients.  ");
   std::println("                         This path must not refer to a target that exists, or this program ");
   std::println("                          will refuse to start up.                                         ");
+  std::println("                         When a listening socket is passed by a service manager through    ");
+  std::println("                          LISTEN_FDS, it is used instead and left in place on shutdown, so ");
+  std::println("                          that clients keep queuing on it while the server restarts.       ");
   std::println("                                                                                           ");
   std::println("  --manual-initialize   Request to initialize some entries manually into the storage.      ");
   std::println("                                                                                           ");
+  std::println("  --snapshot PATH       Load the encrypted snapshot at PATH on startup if it exists, and save");
+  std::println("                         all secrets into it on shutdown. The snapshot is sealed with a key  ");
+  std::println("                         derived from a passphrase asked interactively on startup, unless   ");
+  std::println("                         --snapshot-keyring is specified.                                  ");
+  std::println("                                                                                           ");
+  std::println("  --snapshot-keyring DESCRIPTION                                                           ");
+  std::println("                        Derive the snapshot key from the user key with DESCRIPTION in the  ");
+  std::println("                         kernel keyring instead of asking for a passphrase.                ");
+  std::println("                                                                                           ");
+  std::println("  --metrics-socket PATH Serve metrics in prometheus text format over HTTP on another socket");
+  std::println("                         at PATH, e.g. for curl --unix-socket PATH http://localhost/metrics");
+  std::println("                                                                                           ");
+  std::println("  --policy PATH         Authorize each request by the credentials of its peer with rules   ");
+  std::println("                         in PATH, one per line as PREFIX SUBJECT PERMISSIONS, e.g.         ");
+  std::println("                           app/ uid=1000 rwld                                              ");
+  std::println("                         PREFIX is * for all keys, SUBJECT is *, uid=N, gid=N or exe=PATH, ");
+  std::println("                         PERMISSIONS are r(ead), l(ist), w(rite), d(elete) and a(dmin).    ");
+  std::println("                         Keys are governed by the longest matching prefix, others are      ");
+  std::println("                         denied. Without a policy anyone reaching the socket is trusted.   ");
+  std::println("                                                                                           ");
+  std::println("  --io-timeout MILLISECONDS                                                                ");
+  std::println("                        Drop a client that stalls for longer than this on a single read or ");
+  std::println("                         write, 5000 by default.                                           ");
+  std::println("                                                                                           ");
+  std::println("  --grace-period SECONDS                                                                   ");
+  std::println("                        On Terminate, SIGINT or SIGTERM, stop accepting new clients and    ");
+  std::println("                         keep serving those already waiting for at most this long, 5 by    ");
+  std::println("                         default. All locked memory is wiped before exiting.               ");
+  std::println("                                                                                           ");
+  std::println("  --backlog N           Let the kernel hold at most N connections not accepted yet, 128 by ");
+  std::println("                         default.                                                          ");
+  std::println("                                                                                           ");
+  std::println("  --max-queued N        Accept at most N connections waiting to be served, 64 by default.  ");
+  std::println("                         Any other one is replied busy with a hint when to retry right away");
+  std::println("                         instead of waiting, which the accessor does with a jittered       ");
+  std::println("                         backoff.                                                          ");
+  std::println("                                                                                           ");
+  std::println("  --max-per-peer N      Accept at most N connections waiting to be served from one user, 16");
+  std::println("                         by default, so that no client can take all room in the queue.     ");
+  std::println("                                                                                           ");
+  std::println("  --reserve-locked BYTES                                                                   ");
+  std::println("                        Map, lock and fault in at least BYTES of memory for secrets on     ");
+  std::println("                         startup instead of a page at a time while serving, and refuse to  ");
+  std::println("                         start if RLIMIT_MEMLOCK does not allow as much. With several      ");
+  std::println("                         reactors, BYTES is split evenly across the memory of each.        ");
+  std::println("                                                                                           ");
+  std::println("  --reactors N          Serve with N threads, each pinned to a core and owning a share of  ");
+  std::println("                         the storage, 1 by default. Reactor K > 0 listens on the socket    ");
+  std::println("                         path suffixed by .K, and the accessor sends each request on a key ");
+  std::println("                         to the reactor owning it. On hosts with several NUMA nodes,       ");
+  std::println("                         reactors are spread over the nodes in turn, and each one but the  ");
+  std::println("                         first keeps the secrets it stores in memory of its own node.      ");
+  std::println("                                                                                           ");
+  std::println("  --quota BYTES         Hold at most BYTES of secrets, counting keys, values and an        ");
+  std::println("                         overhead per secret, unlimited by default. A secret that would    ");
+  std::println("                         exceed it evicts secrets added as evictable, least recently used  ");
+  std::println("                         first, and is refused if that is not enough, so that the server   ");
+  std::println("                         never runs out of locked memory, which is handled the same way    ");
+  std::println("                         should it happen nonetheless.                                     ");
+  std::println("                                                                                           ");
+  std::println("  --namespace-quota BYTES                                                                  ");
+  std::println("                        Hold at most BYTES of secrets in each namespace, the part of keys  ");
+  std::println("                         up to and including their first /, unlimited by default. A secret ");
+  std::println("                         that would exceed it evicts only secrets of its own namespace.    ");
+  std::println("                                                                                           ");
+  std::println("  --hot-bytes BYTES     Keep at most BYTES of values in locked memory, and seal all others ");
+  std::println("                         with AES-256-GCM into ordinary memory excluded from core dumps, so");
+  std::println("                         that the number of secrets held is not bound by RLIMIT_MEMLOCK.   ");
+  std::println("                         Values are sealed as they are stored and unsealed as they are     ");
+  std::println("                         read, the least recently read being sealed again once the limit is");
+  std::println("                         exceeded. The key sealing them is drawn on startup and never      ");
+  std::println("                         leaves locked memory. Nothing is sealed by default.               ");
+  std::println("                                                                                           ");
+  std::println("  --capture PATH        Record every request served into PATH for secret-storage-replay,   ");
+  std::println("                         with its type, flags, outcome, arrival time, connection and the   ");
+  std::println("                         sizes of its key and value, but only a hash of its key keyed for  ");
+  std::println("                         this run, and never the key or the value themselves.              ");
+  std::println("                                                                                           ");
+  std::println("  --standby             Run as a hot standby of the server listening on the socket, which  ");
+  std::println("                         must grant the admin permission to this user. The standby keeps a ");
+  std::println("                         copy of all secrets in its own locked memory, receiving every     ");
+  std::println("                         change as it is made, and takes the socket over once the primary  ");
+  std::println("                         is gone, so that clients are served again within milliseconds. It ");
+  std::println("                         shall be started with the same --reactors.                        ");
+  std::println("                                                                                           ");
+#ifdef Tracing
+  std::println("  --trace PATH          Write the trace of recent requests as Chrome trace JSON into PATH  ");
+  std::println("                         whenever SIGUSR2 is received, by default into                     ");
+  std::println("                         /tmp/secret-storage-PID.trace.json                                ");
+  std::println("                                                                                           ");
+#endif
   std::println("  --help                Show this message again                                            ");
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "hardened_memory_allocator.hh"
+#include <algorithm>
+#include <chrono>
+#include <configuration.hh>
+#include <cstdio>
+#include <functional>
+#include <new>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class Parser : public Configurations {
+public:
+  Parser() {
+    this->add_option("--iterations", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--threads", Configurations::CommonParsers::identity_parser, 1);
+  }
+  void help() const override {
+    std::println("hardened-memory-allocator-bench v{}, micro-benchmarks of the allocator", VERSION);
+    std::println(" This program is part of secret-storage                                         ");
+    std::println("                                                                                ");
+    std::println("Usage: hardened-memory-allocator-bench [OPTIONS...]                             ");
+    std::println("OPTIONS:                                                                        ");
+    std::println("  --iterations N  Number of operations in each benchmark, 100000 by default.    ");
+    std::println("                   Benchmarks keeping blocks alive run at most 16384 operations.");
+    std::println("                                                                                ");
+    std::println("  --threads N     Number of threads in the contention benchmark, 4 by default.  ");
+  }
+};
+
+// all benchmarks use fixed seeds so that runs are comparable across builds
+static constexpr uint64_t seed = 0x5ec2e7;
+// benchmarks that keep memory alive are bounded to stay well within the default RLIMIT_MEMLOCK
+static constexpr size_t live_limit = 16384;
+
+static auto resident_bytes() -> size_t {
+  size_t size     = 0;
+  size_t resident = 0;
+  FILE  *file     = fopen("/proc/self/statm", "r");
+  if (file == nullptr) {
+    return 0;
+  }
+  if (fscanf(file, "%zu %zu", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(file);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+struct Measurement {
+  const char *name;
+  size_t      operations;
+  double      nanoseconds;
+  size_t      pages;
+  size_t      resident;
+};
+
+static auto measure(const char *name, size_t operations, const std::function<void()> &benchmark)
+  -> Measurement {
+  const auto begin = std::chrono::steady_clock::now();
+  benchmark();
+  const auto end = std::chrono::steady_clock::now();
+  return {
+    name,
+    operations,
+    std::chrono::duration<double, std::nano>(end - begin).count(),
+    HardenedMemoryManager::mapped_pages(),
+    resident_bytes(),
+  };
+}
+
+// construct and destroy short secured strings of random length, like request handling does
+static void string_churn(size_t iterations, uint64_t seed) {
+  std::mt19937_64                       random(seed);
+  std::uniform_int_distribution<size_t> length(8, 256);
+  for (size_t i = 0; i < iterations; i++) {
+    secured_string string(length(random), 'x');
+    asm volatile("" : : "r"(string.data()) : "memory");
+  }
+}
+
+static auto map_growth(size_t iterations) -> Measurement {
+  iterations = std::min(iterations, live_limit);
+  secured_unordered_map map;
+  secured_string        key;
+  secured_string        value(64, 'v');
+  return measure("map growth", iterations, [&]() {
+    for (size_t i = 0; i < iterations; i++) {
+      key.assign(std::to_string(i));
+      map.insert_or_assign(key, value);
+    }
+  });
+}
+
+// keep a working set of blocks, replacing a random one with a block of random size each time
+static auto mixed_sizes(size_t iterations) -> Measurement {
+  constexpr size_t                      working_set = 256;
+  std::mt19937_64                       random(seed);
+  std::uniform_int_distribution<size_t> size(16, 2048);
+  std::uniform_int_distribution<size_t> pick(0, working_set - 1);
+  std::vector<void *>                   blocks(working_set, nullptr);
+  auto result = measure("mixed sizes", iterations, [&]() {
+    for (size_t i = 0; i < iterations; i++) {
+      auto &block = blocks[pick(random)];
+      if (block != nullptr) {
+        HardenedMemoryManager::deallocate(block);
+      }
+      block = HardenedMemoryManager::allocate(size(random));
+    }
+  });
+  for (auto *block : blocks) {
+    if (block != nullptr) {
+      HardenedMemoryManager::deallocate(block);
+    }
+  }
+  return result;
+}
+
+// fill memory with blocks, free a random half of them, then allocate into the holes left behind
+//  the pages reported show how well the holes are reused
+static auto fragmentation(size_t iterations) -> Measurement {
+  iterations = std::min(iterations, live_limit);
+  std::mt19937_64                       random(seed);
+  std::uniform_int_distribution<size_t> size(16, 512);
+  std::vector<void *>                   blocks(iterations);
+  for (auto &block : blocks) {
+    block = HardenedMemoryManager::allocate(size(random));
+  }
+  std::ranges::shuffle(blocks, random);
+  const auto half = blocks.size() / 2;
+  for (size_t i = 0; i < half; i++) {
+    HardenedMemoryManager::deallocate(blocks[i]);
+  }
+  auto result = measure("fragmentation", half, [&]() {
+    for (size_t i = 0; i < half; i++) {
+      blocks[i] = HardenedMemoryManager::allocate(size(random));
+    }
+  });
+  for (auto *block : blocks) {
+    HardenedMemoryManager::deallocate(block);
+  }
+  return result;
+}
+
+static auto contention(size_t iterations, size_t threads) -> Measurement {
+  return measure("contention", iterations * threads, [&]() {
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+      workers.emplace_back(string_churn, iterations, seed + i);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  });
+}
+
+auto main(int argc, char **argv) -> int {
+  auto   configuration = Parser().parse(argc, argv);
+  size_t iterations    = 100000;
+  size_t threads       = 4;
+  try {
+    if (configuration.contains("iterations")) {
+      iterations = std::stoul(std::any_cast<std::string>(configuration.at("iterations")));
+    }
+    if (configuration.contains("threads")) {
+      threads = std::stoul(std::any_cast<std::string>(configuration.at("threads")));
+    }
+  } catch (const std::exception &) {
+    std::println(stderr, "invalid numeric argument");
+    return 1;
+  }
+
+#ifndef NDEBUG
+  std::println(stderr, "warning: built without NDEBUG, the allocator logs every call and numbers are skewed");
+#endif
+#ifdef MemoryAllocatorAlwaysFree
+  std::println("allocator build: MemoryAllocatorAlwaysFree");
+#else
+  std::println("allocator build: default");
+#endif
+
+  std::vector<Measurement> measurements;
+  try {
+    measurements.push_back(measure("string churn", iterations, [&]() { string_churn(iterations, seed); }));
+    measurements.push_back(map_growth(iterations));
+    measurements.push_back(mixed_sizes(iterations));
+    measurements.push_back(fragmentation(iterations));
+    measurements.push_back(contention(iterations, threads));
+  } catch (const std::bad_alloc &) {
+    std::println(stderr, "out of locked memory, check RLIMIT_MEMLOCK (ulimit -l)");
+    return 1;
+  }
+
+  std::println(
+    "{:<16}{:>12}{:>12}{:>14}{:>14}", "benchmark", "operations", "ns/op", "pages mapped", "RSS (KiB)"
+  );
+  for (const auto &measurement : measurements) {
+    std::println(
+      "{:<16}{:>12}{:>12.1f}{:>14}{:>14}",
+      measurement.name,
+      measurement.operations,
+      measurement.nanoseconds / std::max<size_t>(measurement.operations, 1),
+      measurement.pages,
+      measurement.resident / 1024
+    );
+  }
+  HardenedMemoryManager::close();
+  return 0;
+}
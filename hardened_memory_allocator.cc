@@ -1,20 +1,43 @@
 #include "hardened_memory_allocator.hh"
+#include "trace.hh"
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <linux/mempolicy.h>
 #include <mutex>
 #include <new>
 #include <print>
 #include <sys/mman.h>
 #include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#include <vector>
+
+// blocks free for allocation, an arena being used by one thread mostly, so that threads do not contend
+//  arenas are never destroyed, and chained so that all of them can be wiped
+struct MemoryArena {
+  MemoryBlock *list{nullptr};
+  std::mutex   mutex;
+  MemoryArena *next{nullptr};
+  // NUMA node pages mapped for the arena are placed on, wherever the thread faulting them in runs if negative
+  int node{-1};
+};
+static MemoryArena main_arena;
+static std::mutex  arenas_mutex;
 
 struct MemoryBlock {
 private:
   size_t size_{0};
 
 public:
-  MemoryBlock *last{nullptr};
+  // a block handed out keeps the arena it came from in place of its links, so that it is freed back into it
+  //  by whichever thread frees it
+  union {
+    MemoryBlock *last{nullptr};
+    MemoryArena *owner;
+  };
   MemoryBlock *next{nullptr};
 
   inline auto size() -> size_t { return this->size_ & ~static_cast<size_t>(1); }
@@ -22,10 +45,12 @@ public:
   inline void mark_as_leader() { this->size_ |= 1; }
   inline auto is_leader() -> bool { return this->size_ & 1; }
 };
+// hidden fields in front of the address handed out, the size of the block and the arena owning it
+static constexpr size_t Header = sizeof(size_t) + sizeof(MemoryArena *);
 
-void HardenedMemoryManager::add_before(MemoryBlock *target, MemoryBlock *before) {
+void HardenedMemoryManager::add_before(MemoryArena *owner, MemoryBlock *target, MemoryBlock *before) {
   if (before->last == nullptr) {
-    list = target;
+    owner->list = target;
   } else {
     before->last->next = target;
   }
@@ -42,10 +67,10 @@ void HardenedMemoryManager::add_after(MemoryBlock *target, MemoryBlock *after) {
   after->next = target;
 }
 
-void HardenedMemoryManager::remove_from_list(MemoryBlock *target) {
+void HardenedMemoryManager::remove_from_list(MemoryArena *owner, MemoryBlock *target) {
   if (target->last == nullptr) {
-    assert(list == target);
-    list = target->next;
+    assert(owner->list == target);
+    owner->list = target->next;
   } else {
     target->last->next = target->next;
   }
@@ -54,35 +79,35 @@ void HardenedMemoryManager::remove_from_list(MemoryBlock *target) {
   }
 }
 
-auto HardenedMemoryManager::do_merge(MemoryBlock *first, MemoryBlock *second) -> bool {
+auto HardenedMemoryManager::do_merge(MemoryArena *owner, MemoryBlock *first, MemoryBlock *second) -> bool {
   if (reinterpret_cast<uint8_t *>(first) + first->size() == reinterpret_cast<uint8_t *>(second)) {
     first->size(first->size() + second->size());
-    remove_from_list(second);
+    remove_from_list(owner, second);
     return true;
   }
   return false;
 }
 
-void HardenedMemoryManager::merge(MemoryBlock *target) {
+void HardenedMemoryManager::merge(MemoryArena *owner, MemoryBlock *target) {
   if (!target->is_leader() && target->last != nullptr) {
     auto last = target->last;
-    if (do_merge(target->last, target)) {
+    if (do_merge(owner, target->last, target)) {
       target = last;
     }
   }
   if (target->next != nullptr && !target->next->is_leader()) {
-    do_merge(target, target->next);
+    do_merge(owner, target, target->next);
   }
 }
 
-void HardenedMemoryManager::add_to_list(MemoryBlock *entry) {
-  if (list == nullptr) {
-    list        = entry;
+void HardenedMemoryManager::add_to_list(MemoryArena *owner, MemoryBlock *entry) {
+  if (owner->list == nullptr) {
+    owner->list = entry;
     entry->last = nullptr;
     entry->next = nullptr;
     return;
   }
-  MemoryBlock *target = list;
+  MemoryBlock *target = owner->list;
   while (target->next != nullptr) {
     if (target > entry) {
       break;
@@ -90,50 +115,110 @@ void HardenedMemoryManager::add_to_list(MemoryBlock *entry) {
     target = target->next;
   }
   if (target > entry) {
-    add_before(entry, target);
+    add_before(owner, entry, target);
   } else {
     add_after(entry, target);
   }
-  merge(entry);
+  merge(owner, entry);
 }
 
-void HardenedMemoryManager::add_page() {
+// every region mapped by the allocator, so that all of them can be wiped at once
+static std::mutex regions_mutex;
+static auto       regions() -> std::unordered_map<void *, size_t> & {
+  // never destroyed, as memory may still be freed while the process exits
+  static auto *regions = new std::unordered_map<void *, size_t>();
+  return *regions;
+}
+static void track(void *region, size_t size) {
+  std::lock_guard<std::mutex> lock(regions_mutex);
+  regions().emplace(region, size);
+}
+static void untrack(void *region) {
+  std::lock_guard<std::mutex> lock(regions_mutex);
+  regions().erase(region);
+}
+
+// place pages of region not faulted in yet on node, unless it is negative
+static void prefer_node(void *region, size_t size, int node) {
+  // only preferred, so that pages still come from another node rather than not at all once it runs short
+  unsigned long mask[16] = {};
+  if (node >= 0 && static_cast<size_t>(node) < sizeof(mask) * 8) {
+    mask[node / 64] |= 1UL << (node % 64);
+    syscall(SYS_mbind, region, size, MPOL_PREFERRED, mask, sizeof(mask) * 8 + 1, 0);
+  }
+}
+
+// map and lock pages for size bytes, placed on node unless it is negative, nullptr if failed
+//  pages are placed as they are faulted in, so with a node they are only faulted in by locking them, once
+//   the policy is set, rather than by MAP_LOCKED right away
+static auto map_locked(size_t size, int node) -> void * {
+  const int flags  = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (node < 0 ? MAP_LOCKED : 0);
+  void     *region = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (region == MAP_FAILED) {
+    return nullptr;
+  }
+  prefer_node(region, size, node);
+  if (mlock(region, size) == -1) {
+    munmap(region, size);
+    return nullptr;
+  }
+  return region;
+}
+
+void HardenedMemoryManager::initialize() {
   [[maybe_unused]] static bool _ = (HardenedMemoryManager::page_size = sysconf(_SC_PAGESIZE));
+}
+
+void HardenedMemoryManager::add_page() {
+  initialize();
 
-  void *page = mmap(
-    nullptr,
-    page_size,
-    PROT_READ | PROT_WRITE,
-    MAP_PRIVATE | MAP_ANONYMOUS | MAP_LOCKED | MAP_NORESERVE,
-    -1,
-    0
-  );
-  if (page == MAP_FAILED) {
+  void *page = map_locked(page_size, arena->node);
+  if (page == nullptr) {
     throw std::bad_alloc();
   }
-  do {
-    if (mlock(page, page_size) == -1) {
-      break;
-    }
-    auto entry = reinterpret_cast<MemoryBlock *>(page);
-    entry->size(page_size);
-    entry->mark_as_leader();
-    add_to_list(entry);
-    return;
-  } while (false);
-  munmap(page, page_size);
-  throw std::bad_alloc();
+  auto entry = reinterpret_cast<MemoryBlock *>(page);
+  entry->size(page_size);
+  entry->mark_as_leader();
+  add_to_list(arena, entry);
+  track(page, page_size);
+  pages.fetch_add(1, std::memory_order_relaxed);
 }
-void HardenedMemoryManager::remove_page(MemoryBlock *entry) {
+void HardenedMemoryManager::remove_page(MemoryArena *owner, MemoryBlock *entry) {
   assert(entry->is_leader() && entry->size() == page_size);
-  remove_from_list(entry);
+  remove_from_list(owner, entry);
+  untrack(entry);
   getrandom(entry, page_size, 0);
   munlock(entry, page_size);
   munmap(entry, page_size);
+  pages.fetch_sub(1, std::memory_order_relaxed);
+}
+
+auto HardenedMemoryManager::add_pages(size_t size) -> MemoryBlock * {
+  size = (size + page_size - 1) / page_size * page_size;
+
+  void *region = map_locked(size, arena->node);
+  if (region == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto entry = reinterpret_cast<MemoryBlock *>(region);
+  entry->size(size);
+  entry->mark_as_leader();
+  track(region, size);
+  pages.fetch_add(size / page_size, std::memory_order_relaxed);
+  return entry;
+}
+void HardenedMemoryManager::remove_pages(MemoryBlock *entry) {
+  assert(entry->is_leader() && entry->size() > page_size);
+  const auto size = entry->size();
+  untrack(entry);
+  getrandom(entry, size, 0);
+  munlock(entry, size);
+  munmap(entry, size);
+  pages.fetch_sub(size / page_size, std::memory_order_relaxed);
 }
 
 auto HardenedMemoryManager::find_suitable_entry(size_t size) -> MemoryBlock * {
-  MemoryBlock *entry = list;
+  MemoryBlock *entry = arena->list;
   while (entry != nullptr) {
     if (entry->size() >= size) {
       break;
@@ -144,8 +229,9 @@ auto HardenedMemoryManager::find_suitable_entry(size_t size) -> MemoryBlock * {
 }
 
 [[nodiscard]] auto HardenedMemoryManager::allocate(size_t size) -> void * {
+  TRACE_SCOPE("allocate", size);
   // add to size so that it takes the hidden fields into account
-  size += sizeof(size_t);
+  size += Header;
   // size must be large enough
   size = std::max(size, sizeof(MemoryBlock));
   // size must be aligned
@@ -155,8 +241,15 @@ auto HardenedMemoryManager::find_suitable_entry(size_t size) -> MemoryBlock * {
 
   MemoryBlock *target = nullptr;
 
+  initialize();
+  if (size > page_size) {
+    target = add_pages(size);
+    memset(reinterpret_cast<uint8_t *>(target) + Header, 0x42, target->size() - Header);
+    return reinterpret_cast<uint8_t *>(target) + Header;
+  }
+
   { // we need a lock from now on till we detached the target entry off the list
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(arena->mutex);
 
     target = find_suitable_entry(size);
     if (target == nullptr) {
@@ -164,64 +257,161 @@ auto HardenedMemoryManager::find_suitable_entry(size_t size) -> MemoryBlock * {
       target = find_suitable_entry(size);
     }
     if (target == nullptr) {
-      // likely allocating block with size of more than one page
-      //  this is not yet implemented
       throw std::bad_alloc();
     }
-    remove_from_list(target);
+    remove_from_list(arena, target);
   }
 
   if (target->size() - size >= sizeof(MemoryBlock)) {
     // we split the block since the remaining part will have enough size
+    //  what it is carved out of was refilled randomly once freed, so the leader bit must not be taken from it
     auto entry = reinterpret_cast<MemoryBlock *>(reinterpret_cast<uint8_t *>(target) + size);
+    *entry     = MemoryBlock();
     entry->size(target->size() - size);
     { // we need a lock to attach the remaining block back
-      std::lock_guard<std::mutex> lock(mutex);
-      add_to_list(entry);
+      std::lock_guard<std::mutex> lock(arena->mutex);
+      add_to_list(arena, entry);
     }
     target->size(size);
   }
+  target->owner = arena;
 
   // fill the allocated part with 0x42
-  memset(reinterpret_cast<uint8_t *>(target) + sizeof(size_t), 0x42, target->size() - sizeof(size_t));
+  memset(reinterpret_cast<uint8_t *>(target) + Header, 0x42, target->size() - Header);
 
 #ifndef NDEBUG
-  std::println("  allocated [0x{:016x}]", reinterpret_cast<uintmax_t>(target) + sizeof(size_t));
+  std::println("  allocated [0x{:016x}]", reinterpret_cast<uintmax_t>(target) + Header);
 #endif
 
-  return reinterpret_cast<uint8_t *>(target) + sizeof(size_t);
+  return reinterpret_cast<uint8_t *>(target) + Header;
 }
 void HardenedMemoryManager::deallocate(void *address) {
-  auto entry = reinterpret_cast<MemoryBlock *>(reinterpret_cast<uint8_t *>(address) - sizeof(size_t));
+  if (wiped.load(std::memory_order_relaxed)) {
+    return;
+  }
+  auto entry = reinterpret_cast<MemoryBlock *>(reinterpret_cast<uint8_t *>(address) - Header);
+  TRACE_SCOPE("deallocate", entry->size());
+  if (entry->size() > page_size) {
+    remove_pages(entry);
+    return;
+  }
   // randomly refill the content of block
-  getrandom(address, entry->size() - sizeof(size_t), 0);
-  std::lock_guard<std::mutex> lock(mutex);
-  add_to_list(entry);
+  getrandom(address, entry->size() - Header, 0);
+  // read before linking the block overwrites it
+  auto *const                 owner = entry->owner;
+  std::lock_guard<std::mutex> lock(owner->mutex);
+  add_to_list(owner, entry);
 #ifndef NDEBUG
   std::println("deallocated [0x{:016x}]", reinterpret_cast<uintmax_t>(address));
 #endif
 #ifdef MemoryAllocatorAlwaysFree
-  HardenedMemoryManager::shrink();
+  HardenedMemoryManager::shrink(owner);
 #endif
 }
-void HardenedMemoryManager::shrink() {
-  MemoryBlock **target = &list;
+void HardenedMemoryManager::shrink(MemoryArena *owner) {
+  MemoryBlock **target = &owner->list;
   while (*target != nullptr) {
     if ((*target)->is_leader() && (*target)->size() == page_size) {
-      remove_page(*target);
+      remove_page(owner, *target);
     } else {
       target = &(*target)->next;
     }
   }
 }
+void HardenedMemoryManager::shrink() {
+  std::lock_guard<std::mutex> lock(arena->mutex);
+  HardenedMemoryManager::shrink(arena);
+}
 void HardenedMemoryManager::close() {
-  HardenedMemoryManager::shrink();
+  std::lock_guard<std::mutex> lock(arena->mutex);
+  HardenedMemoryManager::shrink(arena);
 #ifdef MemoryAllocatorWarnLeakage
-  if (list != nullptr) {
+  if (arena->list != nullptr) {
     std::println(stderr, "non-leader entry found during final cleanup, memory leak or improper merge?");
   }
 #endif
 }
-MemoryBlock *HardenedMemoryManager::list = nullptr;
-size_t       HardenedMemoryManager::page_size;
-std::mutex   HardenedMemoryManager::mutex{};
\ No newline at end of file
+void HardenedMemoryManager::wipe() {
+  std::lock_guard<std::mutex>               arenas_lock(arenas_mutex);
+  std::vector<std::unique_lock<std::mutex>> locks;
+  for (auto *target = &main_arena; target != nullptr; target = target->next) {
+    locks.emplace_back(target->mutex);
+    target->list = nullptr;
+  }
+  std::lock_guard<std::mutex> regions_lock(regions_mutex);
+  wiped.store(true, std::memory_order_relaxed);
+  // pages stay mapped, so that anything still referring to them does not fault
+  for (const auto &[region, size] : regions()) {
+    explicit_bzero(region, size);
+  }
+}
+auto HardenedMemoryManager::create_arena(int node) -> MemoryArena * {
+  auto *const result = new MemoryArena();
+  result->node       = node;
+  std::lock_guard<std::mutex> lock(arenas_mutex);
+  result->next    = main_arena.next;
+  main_arena.next = result;
+  return result;
+}
+void HardenedMemoryManager::use_arena(MemoryArena *target) { arena = target; }
+auto HardenedMemoryManager::reserve(size_t bytes) -> bool {
+  initialize();
+  const auto count = (bytes + page_size - 1) / page_size;
+  rlimit     limit{};
+  // root may lock beyond the limit
+  if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+      && (count + pages.load(std::memory_order_relaxed)) * page_size > limit.rlim_cur) {
+    std::println(
+      stderr, "cannot reserve {} bytes of locked memory, RLIMIT_MEMLOCK is {} bytes", bytes, limit.rlim_cur
+    );
+    return false;
+  }
+  // committed, unlike pages mapped while serving, so that asking for more than there is fails right here
+  //  with a node, pages are only faulted in by locking them, once placed on the node of the arena
+  const int node   = arena->node;
+  const int flags  = MAP_PRIVATE | MAP_ANONYMOUS | (node < 0 ? MAP_LOCKED | MAP_POPULATE : 0);
+  void     *region = mmap(nullptr, count * page_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (region == MAP_FAILED) {
+    std::println(stderr, "cannot reserve {} bytes of locked memory, {}", bytes, strerror(errno));
+    return false;
+  }
+  prefer_node(region, count * page_size, node);
+  if (mlock(region, count * page_size) == -1) {
+    std::println(stderr, "cannot reserve {} bytes of locked memory, {}", bytes, strerror(errno));
+    munmap(region, count * page_size);
+    return false;
+  }
+  // the region is split into pages of their own, so that each of them can be unmapped alone as usual, and
+  //  as they are adjacent, the whole region is inserted into the sorted list at once
+  std::lock_guard<std::mutex> lock(arena->mutex);
+  MemoryBlock                *previous = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    auto *const entry = reinterpret_cast<MemoryBlock *>(reinterpret_cast<uint8_t *>(region) + i * page_size);
+    *entry            = MemoryBlock();
+    entry->size(page_size);
+    entry->mark_as_leader();
+    if (previous == nullptr) {
+      add_to_list(arena, entry);
+    } else {
+      add_after(entry, previous);
+    }
+    track(entry, page_size);
+    previous = entry;
+  }
+  pages.fetch_add(count, std::memory_order_relaxed);
+  return true;
+}
+auto HardenedMemoryManager::relock() -> bool {
+  std::lock_guard<std::mutex> lock(regions_mutex);
+  for (const auto &[region, size] : regions()) {
+    if (mlock(region, size) == -1) {
+      return false;
+    }
+  }
+  return true;
+}
+auto HardenedMemoryManager::mapped_pages() -> size_t { return pages.load(std::memory_order_relaxed); }
+size_t                    HardenedMemoryManager::page_size;
+std::atomic<size_t>       HardenedMemoryManager::pages{0};
+std::atomic<bool>         HardenedMemoryManager::wiped{false};
+thread_local MemoryArena *HardenedMemoryManager::arena = &main_arena;
\ No newline at end of file
@@ -1,44 +1,79 @@
 #ifndef HARDENED_MEMORY_ALLOCATOR_HH_
 #define HARDENED_MEMORY_ALLOCATOR_HH_
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <unordered_map>
 
 struct MemoryBlock;
+struct MemoryArena;
 class HardenedMemoryManager {
 private:
   static constexpr size_t Align = sizeof(uintmax_t);
 
-  static size_t       page_size;
-  static MemoryBlock *list;
-  static std::mutex   mutex;
+  static size_t              page_size;
+  static std::atomic<size_t> pages;
+  static std::atomic<bool>   wiped;
+  // arena the calling thread allocates from, while a block freed goes back into the arena it came from
+  static thread_local MemoryArena *arena;
 
-  static void add_before(MemoryBlock *target, MemoryBlock *before);
+  static void add_before(MemoryArena *owner, MemoryBlock *target, MemoryBlock *before);
   static void add_after(MemoryBlock *target, MemoryBlock *after);
 
-  static void remove_from_list(MemoryBlock *target);
+  static void remove_from_list(MemoryArena *owner, MemoryBlock *target);
 
-  static auto do_merge(MemoryBlock *first, MemoryBlock *second) -> bool;
+  static auto do_merge(MemoryArena *owner, MemoryBlock *first, MemoryBlock *second) -> bool;
 
-  static void merge(MemoryBlock *target);
+  static void merge(MemoryArena *owner, MemoryBlock *target);
 
-  static void add_to_list(MemoryBlock *entry);
+  static void add_to_list(MemoryArena *owner, MemoryBlock *entry);
+
+  static void initialize();
 
   static void add_page();
-  static void remove_page(MemoryBlock *entry);
+  static void remove_page(MemoryArena *owner, MemoryBlock *entry);
+
+  // blocks larger than a page are mapped separately and returned to the system as soon as they are freed
+  static auto add_pages(size_t size) -> MemoryBlock *;
+  static void remove_pages(MemoryBlock *entry);
 
   static auto find_suitable_entry(size_t size) -> MemoryBlock *;
 
+  // return every page of owner that is wholly free to the system, with the mutex of owner held
+  static void shrink(MemoryArena *owner);
+
 public:
   HardenedMemoryManager() = delete;
   [[nodiscard]] static auto allocate(size_t size) -> void *;
   static void               deallocate(void *address);
+  // return every page wholly free in the arena of the calling thread to the system
   static void               shrink();
   static void               close();
+  // overwrite every page mapped, whether anything on it is still in use or not, e.g. right before exiting
+  //  nothing allocated shall be used afterwards, while deallocating becomes a no-op
+  static void               wipe();
+  // map, lock and fault in pages for at least bytes up front, so that allocating does not map pages one at a
+  //  time while serving, fails if they cannot all be locked, e.g. as RLIMIT_MEMLOCK is too low
+  //  reserved pages are otherwise like any other page, and thus returned to the system if shrink is called
+  //  they go into the arena of the calling thread, so a thread with an arena of its own reserves for it
+  [[nodiscard]] static auto reserve(size_t bytes) -> bool;
+  // lock every page mapped again, as locks are not inherited by a child forked, e.g. when daemonizing
+  [[nodiscard]] static auto relock() -> bool;
+
+  // arenas let threads allocate without contending with each other, every thread uses a shared one unless
+  //  told otherwise, e.g. a thread serving a partition of the storage of its own
+  //  pages of an arena are placed on the NUMA node given, if there is one and it has memory left, so that a
+  //   thread pinned to a cpu of it never reaches across to another node for what it allocated
+  [[nodiscard]] static auto create_arena(int node = -1) -> MemoryArena *;
+  static void               use_arena(MemoryArena *arena);
+
+  // number of locked pages currently mapped by the allocator
+  [[nodiscard]] static auto mapped_pages() -> size_t;
 };
 
 template <typename T> class HardenedMemoryAllocator final {
@@ -66,10 +101,20 @@ public:
 
 using secured_string = std::basic_string<char, std::char_traits<char>, HardenedMemoryAllocator<char>>;
 
+// hashes secured strings and views of any other string alike, so that a key received into a buffer can be
+//  looked up without making a secured copy of it first
+struct SecuredStringHash {
+  using is_transparent = void;
+
+  auto operator()(std::string_view string) const noexcept -> size_t {
+    return std::hash<std::string_view>{}(string);
+  }
+};
+
 using secured_unordered_map = std::unordered_map<
   secured_string,
   secured_string,
-  std::hash<secured_string>,
+  SecuredStringHash,
   std::equal_to<>,
   HardenedMemoryAllocator<std::pair<const secured_string, secured_string>>>;
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef HISTOGRAM_HH_
+#define HISTOGRAM_HH_
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// log-linear latency histogram in the spirit of HdrHistogram
+//  values are recorded with a relative error below 1/HalfBuckets, covering the whole range of uint64_t
+//  recording is lock-free and wait-free, a histogram can be read while being recorded into
+class Histogram {
+public:
+  static constexpr size_t SubBucketBits = 7;
+  static constexpr size_t SubBuckets    = 1 << SubBucketBits;
+  static constexpr size_t HalfBuckets   = SubBuckets / 2;
+  static constexpr size_t Buckets       = SubBuckets + (64 - SubBucketBits) * HalfBuckets;
+
+  static constexpr auto index(uint64_t value) -> size_t {
+    if (value < SubBuckets) {
+      return value;
+    }
+    const size_t shift = std::bit_width(value) - SubBucketBits;
+    return SubBuckets + (shift - 1) * HalfBuckets + ((value >> shift) - HalfBuckets);
+  }
+  // the highest value that is recorded into the bucket at index
+  static constexpr auto highest(size_t index) -> uint64_t {
+    if (index < SubBuckets) {
+      return index;
+    }
+    const size_t shift = (index - SubBuckets) / HalfBuckets + 1;
+    const auto   base  = static_cast<uint64_t>((index - SubBuckets) % HalfBuckets + HalfBuckets) << shift;
+    return base + ((static_cast<uint64_t>(1) << shift) - 1);
+  }
+
+  void record(uint64_t value) {
+    this->counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+    this->sum.fetch_add(value, std::memory_order_relaxed);
+    this->raise(value);
+  }
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < Buckets; i++) {
+      this->counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    this->sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    this->raise(other.maximum.load(std::memory_order_relaxed));
+  }
+
+  [[nodiscard]] auto count() const -> uint64_t {
+    uint64_t result = 0;
+    for (const auto &count : this->counts) {
+      result += count.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+  [[nodiscard]] auto max() const -> uint64_t { return this->maximum.load(std::memory_order_relaxed); }
+  [[nodiscard]] auto mean() const -> double {
+    const auto total = this->count();
+    return total == 0 ? 0 : static_cast<double>(this->sum.load(std::memory_order_relaxed)) / total;
+  }
+  // value at the given percentile, in range [0, 100]
+  [[nodiscard]] auto percentile(double percentile) const -> uint64_t {
+    const auto total = this->count();
+    if (total == 0) {
+      return 0;
+    }
+    auto     target     = static_cast<uint64_t>(percentile / 100 * total + 0.5);
+    uint64_t cumulative = 0;
+    target              = target == 0 ? 1 : target;
+    for (size_t i = 0; i < Buckets; i++) {
+      cumulative += this->counts[i].load(std::memory_order_relaxed);
+      if (cumulative >= target) {
+        return std::min(highest(i), this->max());
+      }
+    }
+    return this->max();
+  }
+  // visit each non-empty bucket with its highest value and its count, in ascending order of values
+  template <typename Callback> void for_each(Callback &&callback) const {
+    for (size_t i = 0; i < Buckets; i++) {
+      const auto count = this->counts[i].load(std::memory_order_relaxed);
+      if (count != 0) {
+        callback(highest(i), count);
+      }
+    }
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, Buckets> counts{};
+  std::atomic<uint64_t>                      sum{0};
+  std::atomic<uint64_t>                      maximum{0};
+
+  void raise(uint64_t value) {
+    auto maximum = this->maximum.load(std::memory_order_relaxed);
+    while (value > maximum &&
+           !this->maximum.compare_exchange_weak(maximum, value, std::memory_order_relaxed)) {
+    }
+  }
+};
+#endif
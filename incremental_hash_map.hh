@@ -0,0 +1,244 @@
+#ifndef INCREMENTAL_HASH_MAP_HH_
+#define INCREMENTAL_HASH_MAP_HH_
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// hash map with separate chaining that grows without rehashing every entry at once
+//  once it is full, a table twice as large is allocated and each insertion or removal afterwards migrates a
+//   few buckets of the old table into it, so no single operation pays for moving all entries
+//  until migrating completes, a key is looked up in the old table if its bucket there is not migrated yet,
+//   and in the new one otherwise, so a lookup still searches a single bucket
+//  the digest of each key is kept in its node, so that migrating never hashes a key again
+//  nodes never move, so pointers to entries stay valid until they are erased
+//  an insertion failing to allocate, e.g. as locked memory runs out, throws and leaves the map as it was
+template <typename Key, typename Value, typename Hash, typename Equal, typename Allocator>
+class IncrementalHashMap final {
+public:
+  using value_type = std::pair<const Key, Value>;
+
+  IncrementalHashMap() { this->current = allocate_table(InitialBuckets); }
+  IncrementalHashMap(const IncrementalHashMap &)                     = delete;
+  IncrementalHashMap(IncrementalHashMap &&)                          = delete;
+  auto operator=(const IncrementalHashMap &) -> IncrementalHashMap & = delete;
+  auto operator=(IncrementalHashMap &&) -> IncrementalHashMap      & = delete;
+  ~IncrementalHashMap() {
+    this->release_table(this->old);
+    this->release_table(this->current);
+  }
+
+  [[nodiscard]] auto size() const -> size_t { return this->count; }
+
+  // every operation may be given the digest of key by Hash if it is known already, so that it is not hashed
+  //  again
+  template <typename K> [[nodiscard]] auto find(const K &key) const -> value_type * {
+    return this->find(key, Hash{}(key));
+  }
+  template <typename K> [[nodiscard]] auto find(const K &key, size_t digest) const -> value_type * {
+    for (auto *node = *this->bucket(digest); node != nullptr; node = node->next) {
+      if (node->digest == digest && Equal{}(node->value.first, key)) {
+        return &node->value;
+      }
+    }
+    return nullptr;
+  }
+
+  // insert an entry unless key exists, return the entry of key and whether it was inserted
+  template <typename K, typename V> auto try_emplace(K &&key, V &&value) -> std::pair<value_type *, bool> {
+    const auto digest = Hash{}(key);
+    return this->insert<false>(std::forward<K>(key), std::forward<V>(value), digest);
+  }
+  template <typename K, typename V>
+  auto try_emplace(K &&key, V &&value, size_t digest) -> std::pair<value_type *, bool> {
+    return this->insert<false>(std::forward<K>(key), std::forward<V>(value), digest);
+  }
+
+  // insert an entry or replace the value of an existing one, return the entry of key and whether it was
+  //  inserted
+  template <typename K, typename V>
+  auto insert_or_assign(K &&key, V &&value) -> std::pair<value_type *, bool> {
+    const auto digest = Hash{}(key);
+    return this->insert<true>(std::forward<K>(key), std::forward<V>(value), digest);
+  }
+  template <typename K, typename V>
+  auto insert_or_assign(K &&key, V &&value, size_t digest) -> std::pair<value_type *, bool> {
+    return this->insert<true>(std::forward<K>(key), std::forward<V>(value), digest);
+  }
+
+  template <typename K> auto erase(const K &key) -> size_t { return this->erase(key, Hash{}(key)); }
+  template <typename K> auto erase(const K &key, size_t digest) -> size_t {
+    auto *const node = this->unlink(key, digest);
+    if (node == nullptr) {
+      return 0;
+    }
+    release_node(node);
+    return 1;
+  }
+
+  // remove the entry of key and return its value, which is moved out instead of copied
+  template <typename K> auto extract(const K &key) -> std::optional<Value> {
+    return this->extract(key, Hash{}(key));
+  }
+  template <typename K> auto extract(const K &key, size_t digest) -> std::optional<Value> {
+    auto *const node = this->unlink(key, digest);
+    if (node == nullptr) {
+      return {};
+    }
+    std::optional<Value> result(std::move(node->value.second));
+    release_node(node);
+    return result;
+  }
+
+  // visit every entry in no particular order
+  template <typename Callback> void for_each(Callback &&callback) const {
+    for (size_t i = this->migrated; this->old.buckets != nullptr && i <= this->old.mask; i++) {
+      for (const auto *node = this->old.buckets[i]; node != nullptr; node = node->next) {
+        callback(node->value);
+      }
+    }
+    for (size_t i = 0; i <= this->current.mask; i++) {
+      for (const auto *node = this->current.buckets[i]; node != nullptr; node = node->next) {
+        callback(node->value);
+      }
+    }
+  }
+
+private:
+  struct Node {
+    Node      *next;
+    size_t     digest;
+    value_type value;
+
+    template <typename K, typename V>
+    Node(Node *next, size_t digest, K &&key, V &&value)
+        : next(next), digest(digest), value(std::forward<K>(key), std::forward<V>(value)) {}
+  };
+  struct Table {
+    Node **buckets{nullptr};
+    size_t mask{0};
+  };
+  using NodeAllocator   = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using BucketAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node *>;
+
+  static constexpr size_t InitialBuckets = 16;
+  // buckets of the old table migrated by every insertion or removal, the old table is always drained before
+  //  the new one fills up as it takes at least as many insertions as there are buckets to migrate
+  static constexpr size_t MigrationStep  = 4;
+
+  Table  current;
+  Table  old;
+  size_t migrated{0};
+  size_t count{0};
+
+  static auto allocate_table(size_t buckets) -> Table {
+    Table result{BucketAllocator().allocate(buckets), buckets - 1};
+    std::fill_n(result.buckets, buckets, nullptr);
+    return result;
+  }
+
+  static void release_node(Node *node) {
+    std::destroy_at(node);
+    NodeAllocator().deallocate(node, 1);
+  }
+
+  void release_table(Table &table) {
+    if (table.buckets == nullptr) {
+      return;
+    }
+    // buckets of the old table already migrated are empty
+    for (size_t i = 0; i <= table.mask; i++) {
+      for (auto *node = table.buckets[i]; node != nullptr;) {
+        auto *const next = node->next;
+        release_node(node);
+        node = next;
+      }
+    }
+    BucketAllocator().deallocate(table.buckets, table.mask + 1);
+    table = {};
+  }
+
+  // the bucket holding key of digest, wherever it is while migrating
+  [[nodiscard]] auto bucket(size_t digest) const -> Node ** {
+    if (this->old.buckets != nullptr && (digest & this->old.mask) >= this->migrated) {
+      return &this->old.buckets[digest & this->old.mask];
+    }
+    return &this->current.buckets[digest & this->current.mask];
+  }
+
+  void grow() {
+    // not expected to happen as migrating keeps ahead of insertions, but it is finished right away if it does
+    while (this->old.buckets != nullptr) {
+      this->migrate();
+    }
+    // allocated first, so that the map is left as it was if it cannot be
+    const auto table = allocate_table((this->current.mask + 1) * 2);
+    this->old        = this->current;
+    this->current    = table;
+    this->migrated   = 0;
+  }
+
+  void migrate() {
+    if (this->old.buckets == nullptr) {
+      return;
+    }
+    for (size_t i = 0; i < MigrationStep && this->migrated <= this->old.mask; i++, this->migrated++) {
+      for (auto *node = this->old.buckets[this->migrated]; node != nullptr;) {
+        auto *const next = node->next;
+        auto      **head = &this->current.buckets[node->digest & this->current.mask];
+        node->next       = *head;
+        *head            = node;
+        node             = next;
+      }
+      this->old.buckets[this->migrated] = nullptr;
+    }
+    if (this->migrated > this->old.mask) {
+      this->release_table(this->old);
+      this->migrated = 0;
+    }
+  }
+
+  template <bool Assign, typename K, typename V>
+  auto insert(K &&key, V &&value, size_t digest) -> std::pair<value_type *, bool> {
+    this->migrate();
+    auto **head = this->bucket(digest);
+    for (auto *node = *head; node != nullptr; node = node->next) {
+      if (node->digest == digest && Equal{}(node->value.first, key)) {
+        if constexpr (Assign) {
+          node->value.second = std::forward<V>(value);
+        }
+        return {&node->value, false};
+      }
+    }
+    if (this->count > this->current.mask) {
+      this->grow();
+      head = this->bucket(digest);
+    }
+    auto *const node = NodeAllocator().allocate(1);
+    try {
+      std::construct_at(node, *head, digest, std::forward<K>(key), std::forward<V>(value));
+    } catch (...) {
+      NodeAllocator().deallocate(node, 1);
+      throw;
+    }
+    *head = node;
+    this->count++;
+    return {&node->value, true};
+  }
+
+  // detach the node of key from its bucket, nullptr if there is none
+  template <typename K> auto unlink(const K &key, size_t digest) -> Node * {
+    this->migrate();
+    for (auto **link = this->bucket(digest); *link != nullptr; link = &(*link)->next) {
+      auto *const node = *link;
+      if (node->digest == digest && Equal{}(node->value.first, key)) {
+        *link = node->next;
+        this->count--;
+        return node;
+      }
+    }
+    return nullptr;
+  }
+};
+#endif
@@ -1,9 +1,19 @@
 #include "command_line.hh"
+#include "policy.hh"
 #include "server.hh"
+#include "snapshot.hh"
+#include "standby.hh"
 #include "storage.hh"
+#include "trace.hh"
 #include "utility.hh"
+#include <algorithm>
 #include <any>
+#include <chrono>
+#include <cstdlib>
+#include <format>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <print>
 #include <unistd.h>
 
@@ -11,9 +21,99 @@ auto main(int argc, char **argv) -> int {
   const auto parser        = CommandLineParser();
   const auto configuration = parser.parse(argc, argv);
 
-  Storage storage;
+  // registered first, so that it runs after everything holding secrets, including the server, is destroyed
+  std::atexit([]() { HardenedMemoryManager::wipe(); });
 
-  auto server = Server::build(storage);
+  std::chrono::milliseconds io_timeout(5000);
+  std::chrono::milliseconds grace_period(5000);
+  int                       backlog         = 128;
+  size_t                    max_queued      = 64;
+  size_t                    max_per_peer    = 16;
+  size_t                    reserve_locked  = 0;
+  size_t                    reactors        = 1;
+  size_t                    quota           = 0;
+  size_t                    namespace_quota = 0;
+  std::optional<size_t>     hot_bytes;
+  try {
+    if (configuration.contains("io-timeout")) {
+      io_timeout =
+        std::chrono::milliseconds(std::stoul(std::any_cast<std::string>(configuration.at("io-timeout"))));
+    }
+    if (configuration.contains("grace-period")) {
+      grace_period =
+        std::chrono::seconds(std::stoul(std::any_cast<std::string>(configuration.at("grace-period"))));
+    }
+    if (configuration.contains("backlog")) {
+      backlog = std::stoi(std::any_cast<std::string>(configuration.at("backlog")));
+    }
+    if (configuration.contains("max-queued")) {
+      max_queued = std::stoul(std::any_cast<std::string>(configuration.at("max-queued")));
+    }
+    if (configuration.contains("max-per-peer")) {
+      max_per_peer = std::stoul(std::any_cast<std::string>(configuration.at("max-per-peer")));
+    }
+    if (configuration.contains("reserve-locked")) {
+      reserve_locked = std::stoull(std::any_cast<std::string>(configuration.at("reserve-locked")));
+    }
+    if (configuration.contains("reactors")) {
+      reactors = std::max<size_t>(std::stoul(std::any_cast<std::string>(configuration.at("reactors"))), 1);
+    }
+    if (configuration.contains("quota")) {
+      quota = std::stoull(std::any_cast<std::string>(configuration.at("quota")));
+    }
+    if (configuration.contains("namespace-quota")) {
+      namespace_quota = std::stoull(std::any_cast<std::string>(configuration.at("namespace-quota")));
+    }
+    if (configuration.contains("hot-bytes")) {
+      hot_bytes = std::stoull(std::any_cast<std::string>(configuration.at("hot-bytes")));
+    }
+  } catch (const std::exception &) {
+    std::println(stderr, "invalid numeric argument");
+    return 0;
+  }
+
+  // split evenly across the arenas of the reactors, the share of the first one is reserved here, before
+  //  anything is allocated, so that secrets loaded on startup are placed into the pages reserved too
+  reserve_locked = (reserve_locked + reactors - 1) / reactors;
+  if (reserve_locked != 0 && !HardenedMemoryManager::reserve(reserve_locked)) {
+    std::println(stderr, "failed to reserve locked memory!");
+    return 0;
+  }
+
+  // a partition of the storage per reactor, so that reactors serving keys of their own never contend
+  Storage storage(reactors);
+  storage.set_quotas(quota, namespace_quota);
+  if (hot_bytes.has_value() && !storage.enable_cold_tier(hot_bytes.value())) {
+    std::println(stderr, "failed to set up the cold tier!");
+    return 0;
+  }
+
+  auto &server = Server::build(storage);
+  server.set_deadlines(io_timeout, grace_period);
+  server.set_limits(backlog, max_queued, max_per_peer);
+  server.set_reactors(reactors);
+  server.set_reserve(reserve_locked);
+
+  std::optional<Snapshot> snapshot;
+  if (configuration.contains("snapshot")) {
+    const auto path = std::any_cast<std::string>(configuration.at("snapshot"));
+    if (configuration.contains("snapshot-keyring")) {
+      snapshot = Snapshot::from_keyring(
+        path, std::any_cast<std::string>(configuration.at("snapshot-keyring")).c_str()
+      );
+    } else {
+      const auto passphrase = ask_secret<secured_string::allocator_type>("Snapshot passphrase");
+      snapshot              = Snapshot::from_passphrase(path, {passphrase.data(), passphrase.size()});
+    }
+    if (!snapshot.has_value()) {
+      std::println(stderr, "failed to derive snapshot key!");
+      return 0;
+    }
+    if (snapshot->exists() && !snapshot->load(storage)) {
+      std::println(stderr, "failed to load snapshot!");
+      return 0;
+    }
+  }
 
   if (configuration.contains("manual-initialize")) {
     secured_string key;
@@ -34,20 +134,50 @@ auto main(int argc, char **argv) -> int {
       if (value.size() == 0) {
         break;
       }
-      storage.add(std::move(key), std::move(value));
+      const auto stored = storage.add(key, value);
+      if (stored == Storage::Result::Exists) {
+        std::println("  !! key exists already !!");
+      } else if (stored != Storage::Result::Added) {
+        std::println("  !! secret does not fit into the quotas or locked memory !!");
+      }
     }
   }
   fclose(stdin);
-  bool start_status = true;
+  std::optional<std::string> socket_path;
   if (configuration.contains("socket")) {
-    start_status = server.start(std::any_cast<std::string>(configuration.at("socket")).c_str());
-  } else {
-    start_status = server.start();
+    socket_path = std::any_cast<std::string>(configuration.at("socket"));
   }
-  if (start_status == false) {
+  const char *address = socket_path.has_value() ? socket_path->c_str() : nullptr;
+  // a standby connects to the primary on the socket before daemonizing, so that failing to is told, and
+  //  starts the server on it only once the primary is gone
+  std::unique_ptr<Standby> standby;
+  if (configuration.contains("standby")) {
+    const auto primary = make_address(address);
+    if (primary.has_value()) {
+      standby = Standby::connect(primary.value(), reactors);
+    }
+    if (standby == nullptr) {
+      std::println(stderr, "failed to connect to the primary!");
+      return 0;
+    }
+  } else if (!server.start(address)) {
     std::println(stderr, "failed to start server!");
     return 0;
   }
+  if (configuration.contains("policy")) {
+    auto policy = Policy::load(std::any_cast<std::string>(configuration.at("policy")).c_str());
+    if (!policy.has_value()) {
+      std::println(stderr, "failed to load policy!");
+      return 0;
+    }
+    server.enforce(std::move(policy.value()));
+  }
+  if (configuration.contains("metrics-socket")) {
+    if (!server.start_metrics(std::any_cast<std::string>(configuration.at("metrics-socket")).c_str())) {
+      std::println(stderr, "failed to start metrics server!");
+      return 0;
+    }
+  }
   if (configuration.contains("daemon")) {
     pid_t pid = fork();
     if (pid == -1) {
@@ -62,14 +192,54 @@ auto main(int argc, char **argv) -> int {
         return -1;
       }
       if (pid != 0) {
-        exit(EXIT_SUCCESS);
+        // neither the server of this process shall be destroyed, or it would unlink the socket in use by the
+        //  daemon, nor shall its copy of secrets be left behind
+        HardenedMemoryManager::wipe();
+        _exit(EXIT_SUCCESS);
+      }
+      // the daemon does not inherit the locks of its parent on the pages holding secrets
+      if (!HardenedMemoryManager::relock()) {
+        std::println(stderr, "failed to lock memory, {}", strerror(errno));
+        return -1;
       }
       fclose(stdout);
       fclose(stderr);
     } else {
-      exit(EXIT_SUCCESS);
+      HardenedMemoryManager::wipe();
+      _exit(EXIT_SUCCESS);
+    }
+  }
+#ifdef Tracing
+  // after daemonizing, as only the calling thread survives a fork
+  const auto trace = configuration.contains("trace")
+                     ? std::any_cast<std::string>(configuration.at("trace"))
+                     : std::format("/tmp/secret-storage-{}.trace.json", getpid());
+  if (!Trace::start(trace.c_str())) {
+    std::println(stderr, "failed to start tracing!");
+    return 0;
+  }
+#endif
+  // after daemonizing too, as the capture is written out by a thread of its own
+  if (configuration.contains("capture")) {
+    if (!server.start_capture(std::any_cast<std::string>(configuration.at("capture")).c_str())) {
+      std::println(stderr, "failed to start capturing!");
+      return 0;
+    }
+  }
+  if (standby != nullptr) {
+    if (!standby->follow(storage)) {
+      std::println(stderr, "primary is gone before its secrets were received!");
+      return 0;
+    }
+    standby.reset();
+    if (!server.start(address)) {
+      std::println(stderr, "failed to start server!");
+      return 0;
     }
   }
   server.serve();
+  if (snapshot.has_value() && !snapshot->save(storage)) {
+    std::println(stderr, "failed to save snapshot!");
+  }
   return 0;
 }
\ No newline at end of file
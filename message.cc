@@ -1,23 +1,168 @@
 #include "message.hh"
+#include "trace.hh"
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <format>
 #include <print>
 #include <stack>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
 #ifndef DefaultSocketName
 #define DefaultSocketName "secret-storage.sock"
 #endif
 
-void SingleEntryBody::receive(int socket_fd) {
-  recv(socket_fd, &this->length, sizeof(this->length), MSG_WAITALL);
-  recv(socket_fd, this->data, this->length, MSG_WAITALL);
+// length of the message at the front of data of which received bytes are at hand, or the number of bytes
+//  needed to tell it if fewer than that are
+static auto message_length(const uint8_t *data, size_t received) -> size_t {
+  if (received < sizeof(Message)) {
+    return sizeof(Message);
+  }
+  const auto *const message = reinterpret_cast<const Message *>(data);
+  switch (message->type) {
+  case Message::Type::Add: {
+    if (received < sizeof(Message) + sizeof(DoubleEntryBody)) {
+      return sizeof(Message) + sizeof(DoubleEntryBody);
+    }
+    const auto *const body = reinterpret_cast<const DoubleEntryBody *>(message->data);
+    return sizeof(Message) + sizeof(DoubleEntryBody) + body->length[0] + body->length[1];
+  }
+  case Message::Type::Failed:
+    if (!(message->flags & Message::Flags::Failed_DescriptionAttached)) {
+      return sizeof(Message);
+    }
+    [[fallthrough]];
+  case Message::Type::Ping:
+  case Message::Type::Pong:
+  case Message::Type::Query:
+  case Message::Type::Delete:
+  case Message::Type::Result:
+  case Message::Type::ListPrefix:
+  case Message::Type::DeletePrefix:
+  case Message::Type::Batch:
+  case Message::Type::Watch:
+  case Message::Type::Event: {
+    if (received < sizeof(Message) + sizeof(SingleEntryBody)) {
+      return sizeof(Message) + sizeof(SingleEntryBody);
+    }
+    const auto *const body = reinterpret_cast<const SingleEntryBody *>(message->data);
+    return sizeof(Message) + sizeof(SingleEntryBody) + body->length;
+  }
+  default:
+    return sizeof(Message);
+  }
 }
-void DoubleEntryBody::receive(int socket_fd) {
-  recv(socket_fd, this->length, sizeof(this->length), MSG_WAITALL);
-  recv(socket_fd, this->data, this->length[0] + this->length[1], MSG_WAITALL);
+
+static auto receive_some(int socket_fd, void *data, size_t length, int flags) -> ssize_t {
+  while (true) {
+    const auto count = recv(socket_fd, data, length, flags);
+    if (count != -1 || errno != EINTR) {
+      return count;
+    }
+  }
+}
+
+auto MessageReceiver::receive() -> bool {
+  TRACE_SCOPE("receive");
+  auto *const data = reinterpret_cast<uint8_t *>(this->buffer);
+  if (this->consumed != 0) {
+    this->received -= this->consumed;
+    memmove(data, data + this->consumed, this->received);
+    this->consumed = 0;
+  }
+  if (this->received == 0) {
+    const auto count = receive_some(this->socket_fd, data, MessageBufferSize, 0);
+    if (count <= 0) {
+      return false;
+    }
+    this->received = count;
+  }
+  while (true) {
+    const auto length = message_length(data, this->received);
+    if (length > MessageBufferSize) {
+      return false;
+    }
+    if (this->received >= length) {
+      this->consumed = length;
+      return true;
+    }
+    // a read cut short, e.g. by the timeout, fails right away, so that a client trickling a message in is not
+    //  waited on once more
+    const auto count =
+      receive_some(this->socket_fd, data + this->received, length - this->received, MSG_WAITALL);
+    if (count < static_cast<ssize_t>(length - this->received)) {
+      return false;
+    }
+    this->received += count;
+  }
+}
+
+auto receive_message(int socket_fd, Message *buffer) -> bool {
+  TRACE_SCOPE("receive");
+  auto *const data     = reinterpret_cast<uint8_t *>(buffer);
+  size_t      received = 0;
+  while (true) {
+    const auto length = message_length(data, received);
+    if (length > MessageBufferSize) {
+      return false;
+    }
+    if (received >= length) {
+      return true;
+    }
+    // only what is still missing of the message is read, the header first and then what its length tells, as
+    //  a peek on a unix socket returns whatever is queued right away, MSG_WAITALL notwithstanding
+    const auto count = receive_some(socket_fd, data + received, length - received, MSG_WAITALL);
+    if (count < static_cast<ssize_t>(length - received)) {
+      return false;
+    }
+    received += count;
+  }
+}
+
+auto peek_header(int socket_fd, Message *header) -> bool {
+  // waiting for the first bytes is bounded by the timeout of the connection, while what follows is not,
+  //  as nothing tells once more of it is queued, so the rest of a header is waited for this long at most
+  static constexpr auto Pause    = std::chrono::milliseconds(1);
+  static constexpr int  Attempts = 1000;
+  for (int attempt = 0; attempt < Attempts; attempt++) {
+    const auto count = receive_some(socket_fd, header, sizeof(Message), MSG_PEEK);
+    if (count <= 0) {
+      return false;
+    }
+    if (count == sizeof(Message)) {
+      return true;
+    }
+    std::this_thread::sleep_for(Pause);
+  }
+  return false;
+}
+
+auto message_type_name(uint8_t type) -> const char * {
+  static constexpr const char *names[Message::Types] = {
+    "ping",
+    "pong",
+    "add",
+    "query",
+    "delete",
+    "ok",
+    "failed",
+    "result",
+    "terminate",
+    "list_prefix",
+    "delete_prefix",
+    "batch",
+    "stats",
+    "watch",
+    "event",
+    "attach",
+    "replicate",
+  };
+  return type < Message::Types ? names[type] : "unknown";
 }
 
 static auto make_directories(const std::filesystem::path &path) -> bool {
@@ -126,4 +271,17 @@ auto make_address(const char *path, bool create) -> std::optional<sockaddr_un> {
   }
   strcpy(address.sun_path, DefaultSocketName);
   return address;
-}
\ No newline at end of file
+}
+
+auto reactor_address(const sockaddr_un &address, size_t index) -> std::optional<sockaddr_un> {
+  if (index == 0) {
+    return address;
+  }
+  const auto  path   = std::format("{}.{}", address.sun_path, index);
+  sockaddr_un result = address;
+  if (path.size() >= sizeof(result.sun_path)) {
+    return {};
+  }
+  strcpy(result.sun_path, path.c_str());
+  return result;
+}
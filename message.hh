@@ -1,9 +1,13 @@
 #ifndef MESSAGE_HH_
 #define MESSAGE_HH_
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <sys/un.h>
 
+// size of buffers used to hold a message, a message including its body shall never exceed this size
+constexpr size_t MessageBufferSize = 2000;
+
 struct Message {
   enum Type : uint8_t {
     Ping, // client -> server, checks if a server is running
@@ -16,8 +20,11 @@ struct Message {
     Add, // client -> server, add a new secret into storage
          //  flags: Add_ReplaceExisting
          //         Add_OneTimeUse
+         //         Add_Evictable
          //  argument: DoubleEntryBody of key and value
          //  reply: an Ok message if succeed, or Failed message otherwise
+         //   a secret that does not fit into the quotas or locked memory of the server even after evicting
+         //   what it could is replied with a Failed message describing why
 
     Query, // client -> server, query some secret
            //  flags: Query_ExistenceOnly
@@ -40,10 +47,73 @@ struct Message {
                //  flags: none, reserved, set to 0
                //  argument: none
                //  reply: none
+
+    ListPrefix, // client -> server, list keys starting with some prefix
+                //  flags: none, reserved, set to 0
+                //  argument: SingleEntryBody of prefix
+                //  reply: a sequence of Result messages each holding one key, terminated by an Ok message
+                //   values are never included
+
+    DeletePrefix, // client -> server, remove all secrets whose key starts with some prefix
+                  //  flags: none, reserved, set to 0
+                  //  argument: SingleEntryBody of prefix
+                  //  reply: a Result message with the number of secrets removed as an uint64_t
+
+    Batch, // client -> server, send a number of messages following over the same connection
+           //  flags: none, reserved, set to 0
+           //  argument: SingleEntryBody with the number of messages following as an uint32_t
+           //  reply: none, each message following is replied in order as if it was sent separately
+           //   Batch, Terminate, Attach and Replicate are not allowed within a batch, such a request, as one
+           //   of an unknown type, is replied with Failed and the connection is closed right after
+
+    Stats, // client -> server, query statistics of the server
+           //  flags: none, reserved, set to 0
+           //  argument: none
+           //  reply: a Result message with a human readable summary of statistics as text
+           //   the summary covers request counts, failures and latency per message type
+
+    Watch, // client -> server, watch changes of a key, or of all keys starting with a prefix
+           //  flags: Watch_Prefix
+           //  argument: SingleEntryBody of key or prefix
+           //  reply: an Ok message if succeed, or Failed message otherwise
+           //   once the request (or the Batch it is part of) is handled, the connection is kept open and
+           //   an Event message is pushed for every change of a key watched, until the client closes it
+           //   the client shall send nothing more over the connection, or it is closed by the server
+
+    Event, // server -> client, a key watched has changed
+           //  flags: Event_Added, Event_Replaced, Event_Deleted, Event_Expired or Event_Evicted
+           //  argument: SingleEntryBody of key, values are never included
+
+    Attach, // client -> server, open a channel in shared memory to send requests over instead of the socket
+            //  flags: none, reserved, set to 0
+            //  argument: none
+            //  reply: an Ok message carrying the memfd of the channel as SCM_RIGHTS if succeed, or Failed
+            //   message otherwise
+            //   the channel is served as long as the connection is kept open, over which the client shall
+            //   send nothing more, requests are authorized as if they were sent over the connection
+            //   Ping, Add, Query, Delete and Stats requests are taken over the channel, see channel.hh
+            //   any other request is replied with Failed
+
+    Replicate, // client -> server, mirror the storage into a hot standby, see standby.hh
+               //  flags: none, reserved, set to 0
+               //  argument: none
+               //  reply: an Add message with Add_ReplaceExisting, along with Add_Evictable if so, for every
+               //   secret held, followed by an Ok message, or a Failed message otherwise
+               //   from then on, every change is pushed as it is made, an Add message as above for a secret
+               //   stored and a Delete message with Delete_AllowMissing for a secret removed, however it is,
+               //   in the order changes of each key are made, until the client closes the connection
+               //   changes made while secrets are sent follow the Ok message, even those included already
+               //   the client shall send nothing more over the connection, and is dropped if it lags behind
+               //   requires the admin permission, as values are included
   } type;
+  // number of message types, keep this in sync with the last message type
+  static constexpr size_t Types = Replicate + 1;
   enum Flags : uint8_t {
     Add_ReplaceExisting = 0x1, // replace corresponding value if the key exists
                                //  an Add operation shall fail by default if the key already exists
+    Add_Evictable = 0x4, // the secret may be evicted to make room for others once the server runs short of
+                         //  its quotas or locked memory, least recently used first, instead of being pinned
+                         //  until deleted
 
     Query_ExistenceOnly = 0x1, // only check if the secret exists and reply with Ok/Failed
                                //  do not retrieve value
@@ -54,6 +124,17 @@ struct Message {
 
     Failed_DescriptionAttached = 0x1, // this Failed massage has a SingleEntryBody with a string
                                       //  which indicates the cause of failure
+    Failed_Busy = 0x2, // the server is overloaded and rejected the connection without reading the request,
+                       //  the description tells how many milliseconds to wait before retrying, as in
+                       //  "busy, retry in 12 ms"
+
+    Watch_Prefix = 0x1, // watch all keys starting with the argument instead of the key itself
+
+    Event_Added    = 0x1,  // a secret was added
+    Event_Replaced = 0x2,  // the value of a secret was replaced
+    Event_Deleted  = 0x4,  // a secret was deleted
+    Event_Expired  = 0x8,  // a secret was consumed by a Query with Query_DeleteSecret
+    Event_Evicted  = 0x10, // an evictable secret was evicted to make room for another one
   };
   uint8_t flags;
   uint8_t data[];
@@ -61,13 +142,53 @@ struct Message {
 struct SingleEntryBody {
   uint16_t length;
   uint8_t  data[];
-  void     receive(int socket_fd);
 };
 struct DoubleEntryBody {
   uint16_t length[2];
   uint8_t  data[];
-  void     receive(int socket_fd);
 };
 
+// receives messages over a connection into a buffer of MessageBufferSize bytes
+//  the buffer is filled with as much as the connection holds at once, so that a message sent in one piece, as
+//   every message is, takes a single recv instead of one for its header, one for the length of its body and
+//   one for the body, and only what is still missing of a message is waited for with MSG_WAITALL
+//  bytes received past a message, e.g. of the next message of a batch, are kept right behind it and moved to
+//   the front of the buffer by the next receive, so the buffer shall not be written to in between
+class MessageReceiver {
+public:
+  MessageReceiver(int socket_fd, Message *buffer) : socket_fd(socket_fd), buffer(buffer) {}
+
+  // receive the next message whole into the buffer, return false if the connection is closed or times out
+  //  before it is complete, or the message does not fit into the buffer
+  auto receive() -> bool;
+  [[nodiscard]] auto message() const -> Message * { return this->buffer; }
+
+private:
+  int      socket_fd;
+  Message *buffer;
+  // bytes at the front of the buffer, and how many of them belong to the message received last
+  size_t received{0};
+  size_t consumed{0};
+};
+// receive exactly one message into buffer of MessageBufferSize bytes, leaving anything following it on the
+//  connection, for connections read one message at a time without keeping a MessageReceiver in between
+//  reads the header first and then the rest of the message, never more than the message itself
+auto receive_message(int socket_fd, Message *buffer) -> bool;
+// wait for the header of the next message on the connection and copy it into header, leaving it on the
+//  connection, return false if the connection is closed or times out first
+//  a peek on a unix socket returns whatever is queued right away, even with MSG_WAITALL, so a header that
+//   arrives in pieces, which a peer sending each message at once never makes, is peeked at again briefly
+auto peek_header(int socket_fd, Message *header) -> bool;
+
 auto make_address(const char *path = nullptr, bool create = false) -> std::optional<sockaddr_un>;
+// address of reactor index of a server running several of them, the first one listens on the address itself
+//  and any other one on the address suffixed by its index, e.g. secret-storage.sock.1
+auto reactor_address(const sockaddr_un &address, size_t index) -> std::optional<sockaddr_un>;
+// reactor, and partition of the storage, owning a key of digest among count of them
+//  taken from the high bits of the digest, as the low bits pick buckets within a partition
+inline auto partition_of(size_t digest, size_t count) -> size_t {
+  return static_cast<size_t>((static_cast<unsigned __int128>(digest) * count) >> 64);
+}
+// name of a message type for diagnostics
+auto message_type_name(uint8_t type) -> const char *;
 #endif
\ No newline at end of file
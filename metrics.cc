@@ -0,0 +1,188 @@
+#include "metrics.hh"
+#include <format>
+#include <memory>
+
+Metrics::Metrics() : started(std::chrono::steady_clock::now()) {}
+
+auto Metrics::slot() -> Slot & {
+  // slots live as long as the process, while a thread exiting hands its slot over to the next thread taking
+  //  one, e.g. as channel threads come and go, which carries on counting into it
+  //  the metrics thus outlive every thread recording into them, as those of the server do
+  struct Lease {
+    Metrics *metrics{nullptr};
+    Slot    *slot{nullptr};
+
+    Lease() = default;
+    Lease(const Lease &)                     = delete;
+    auto operator=(const Lease &) -> Lease & = delete;
+    ~Lease() {
+      if (this->slot != nullptr) {
+        std::lock_guard<std::mutex> lock(this->metrics->mutex);
+        this->metrics->idle_slots.push_back(this->slot);
+      }
+    }
+  };
+  thread_local Lease lease;
+  if (lease.slot == nullptr) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->idle_slots.empty()) {
+      this->slots.push_back(new Slot());
+      this->idle_slots.push_back(this->slots.back());
+    }
+    lease.slot    = this->idle_slots.back();
+    lease.metrics = this;
+    this->idle_slots.pop_back();
+  }
+  return *lease.slot;
+}
+
+void Metrics::record(uint8_t type, std::chrono::nanoseconds duration, bool failed) {
+  if (type >= Message::Types) {
+    return;
+  }
+  auto &slot = this->slot();
+  slot.latency[type].record(duration.count());
+  if (failed) {
+    slot.failures[type].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Metrics::aggregate(Slot &result) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (const auto *slot : this->slots) {
+    for (size_t i = 0; i < Message::Types; i++) {
+      result.latency[i].merge(slot->latency[i]);
+      const auto failures = slot->failures[i].load(std::memory_order_relaxed);
+      result.failures[i].fetch_add(failures, std::memory_order_relaxed);
+    }
+  }
+}
+
+auto Metrics::summary(size_t storage_entries) const -> std::string {
+  auto total = std::make_unique<Slot>();
+  this->aggregate(*total);
+  const auto uptime =
+    std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - this->started);
+  auto result = std::format(
+    "uptime {}s, {} entries, {} connections ({} active, {} queued, {} rejected)\n"
+    "{:<14}{:>10}{:>8}{:>11}{:>11}{:>11}\n",
+    uptime.count(),
+    storage_entries,
+    this->connections.load(std::memory_order_relaxed),
+    this->active_connections.load(std::memory_order_relaxed),
+    this->queued_connections.load(std::memory_order_relaxed),
+    this->rejected_connections.load(std::memory_order_relaxed),
+    "request",
+    "count",
+    "failed",
+    "p50 (us)",
+    "p99 (us)",
+    "p999 (us)"
+  );
+  for (size_t i = 0; i < Message::Types; i++) {
+    const auto &histogram = total->latency[i];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    result += std::format(
+      "{:<14}{:>10}{:>8}{:>11.1f}{:>11.1f}{:>11.1f}\n",
+      message_type_name(i),
+      histogram.count(),
+      total->failures[i].load(std::memory_order_relaxed),
+      histogram.percentile(50) / 1e3,
+      histogram.percentile(99) / 1e3,
+      histogram.percentile(99.9) / 1e3
+    );
+  }
+  return result;
+}
+
+auto Metrics::prometheus(size_t storage_entries) const -> std::string {
+  // upper bounds of buckets exposed, in seconds
+  static constexpr double bounds[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 1e-1, 1
+  };
+
+  auto total = std::make_unique<Slot>();
+  this->aggregate(*total);
+  const auto uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->started);
+
+  std::string result;
+  result += std::format(
+    "# TYPE secret_storage_uptime_seconds gauge\nsecret_storage_uptime_seconds {:.3f}\n", uptime.count()
+  );
+  result += std::format("# TYPE secret_storage_entries gauge\nsecret_storage_entries {}\n", storage_entries);
+  result += std::format(
+    "# TYPE secret_storage_connections_total counter\nsecret_storage_connections_total {}\n",
+    this->connections.load(std::memory_order_relaxed)
+  );
+  result += std::format(
+    "# TYPE secret_storage_active_connections gauge\nsecret_storage_active_connections {}\n",
+    this->active_connections.load(std::memory_order_relaxed)
+  );
+  result += std::format(
+    "# TYPE secret_storage_queued_connections gauge\nsecret_storage_queued_connections {}\n",
+    this->queued_connections.load(std::memory_order_relaxed)
+  );
+  result += std::format(
+    "# TYPE secret_storage_rejected_connections_total counter\n"
+    "secret_storage_rejected_connections_total {}\n",
+    this->rejected_connections.load(std::memory_order_relaxed)
+  );
+
+  result += "# TYPE secret_storage_request_failures_total counter\n";
+  for (size_t i = 0; i < Message::Types; i++) {
+    if (total->latency[i].count() != 0) {
+      result += std::format(
+        "secret_storage_request_failures_total{{type=\"{}\"}} {}\n",
+        message_type_name(i),
+        total->failures[i].load(std::memory_order_relaxed)
+      );
+    }
+  }
+
+  result += "# TYPE secret_storage_request_duration_seconds histogram\n";
+  for (size_t i = 0; i < Message::Types; i++) {
+    const auto &histogram = total->latency[i];
+    const auto  count     = histogram.count();
+    if (count == 0) {
+      continue;
+    }
+    const auto *name = message_type_name(i);
+    // buckets of the histogram are folded into the coarser buckets exposed
+    size_t   bound      = 0;
+    uint64_t cumulative = 0;
+    histogram.for_each([&](uint64_t value, uint64_t number) {
+      while (bound < std::size(bounds) && value > bounds[bound] * 1e9) {
+        result += std::format(
+          "secret_storage_request_duration_seconds_bucket{{type=\"{}\",le=\"{}\"}} {}\n",
+          name,
+          bounds[bound],
+          cumulative
+        );
+        bound++;
+      }
+      cumulative += number;
+    });
+    for (; bound < std::size(bounds); bound++) {
+      result += std::format(
+        "secret_storage_request_duration_seconds_bucket{{type=\"{}\",le=\"{}\"}} {}\n",
+        name,
+        bounds[bound],
+        cumulative
+      );
+    }
+    result += std::format(
+      "secret_storage_request_duration_seconds_bucket{{type=\"{}\",le=\"+Inf\"}} {}\n"
+      "secret_storage_request_duration_seconds_sum{{type=\"{}\"}} {:.9f}\n"
+      "secret_storage_request_duration_seconds_count{{type=\"{}\"}} {}\n",
+      name,
+      count,
+      name,
+      histogram.mean() * count / 1e9,
+      name,
+      count
+    );
+  }
+  return result;
+}
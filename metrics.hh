@@ -0,0 +1,49 @@
+#ifndef METRICS_HH_
+#define METRICS_HH_
+#include "histogram.hh"
+#include "message.hh"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// statistics of a server
+//  each thread records into a slot of its own, so recording never contends and never takes a lock
+//  slots are only aggregated when the statistics are read
+class Metrics {
+public:
+  struct Slot {
+    std::array<std::atomic<uint64_t>, Message::Types> failures{};
+    std::array<Histogram, Message::Types>             latency;
+  };
+
+  std::atomic<uint64_t> connections{0};          // connections accepted
+  std::atomic<uint64_t> active_connections{0};   // connections being served
+  std::atomic<uint64_t> queued_connections{0};   // connections accepted and waiting to be served
+  std::atomic<uint64_t> rejected_connections{0}; // connections replied busy to without being served
+
+  Metrics();
+
+  // record a request of type that was handled in duration, failed if it was replied with Failed
+  void record(uint8_t type, std::chrono::nanoseconds duration, bool failed);
+
+  // human readable summary, short enough to fit into a message
+  [[nodiscard]] auto summary(size_t storage_entries) const -> std::string;
+  // full statistics in prometheus text exposition format
+  [[nodiscard]] auto prometheus(size_t storage_entries) const -> std::string;
+
+private:
+  std::chrono::steady_clock::time_point started;
+  mutable std::mutex                    mutex;
+  std::vector<Slot *>                   slots;
+  // slots of threads that exited, to be taken by the next thread recording
+  std::vector<Slot *>                   idle_slots;
+
+  auto slot() -> Slot &;
+  // aggregate all slots into one
+  void aggregate(Slot &result) const;
+};
+#endif
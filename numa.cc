@@ -0,0 +1,71 @@
+#include "numa.hh"
+#include <fstream>
+#include <sched.h>
+#include <string>
+
+// parse a list of ranges as sysfs prints sets of cpus and nodes in, e.g. "0-3,8-11", empty if malformed
+static auto parse_list(const std::string &text) -> std::vector<int> {
+  std::vector<int> result;
+  size_t           position = 0;
+  while (position < text.size() && text[position] != '\n') {
+    size_t     end   = 0;
+    const auto first = std::stoi(text.substr(position), &end);
+    position += end;
+    auto last = first;
+    if (position < text.size() && text[position] == '-') {
+      last      = std::stoi(text.substr(position + 1), &end);
+      position += end + 1;
+    }
+    for (int i = first; i <= last; i++) {
+      result.push_back(i);
+    }
+    if (position < text.size() && text[position] == ',') {
+      position++;
+    }
+  }
+  return result;
+}
+
+static auto read_list(const std::string &path) -> std::vector<int> {
+  std::ifstream input(path);
+  std::string   text;
+  if (!std::getline(input, text)) {
+    return {};
+  }
+  try {
+    return parse_list(text);
+  } catch (const std::exception &) {
+    return {};
+  }
+}
+
+auto numa_nodes() -> std::vector<NumaNode> {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+    return {{-1, {}}};
+  }
+  std::vector<NumaNode> result;
+  for (const auto id : read_list("/sys/devices/system/node/online")) {
+    NumaNode node{id, {}};
+    for (const auto cpu : read_list("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist")) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+        node.cpus.push_back(cpu);
+      }
+    }
+    // a node without any cpu allowed, e.g. one holding memory only, is never placed on
+    if (!node.cpus.empty()) {
+      result.push_back(std::move(node));
+    }
+  }
+  if (result.size() > 1) {
+    return result;
+  }
+  NumaNode single{-1, {}};
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      single.cpus.push_back(cpu);
+    }
+  }
+  return {single};
+}
@@ -0,0 +1,16 @@
+#ifndef NUMA_HH_
+#define NUMA_HH_
+#include <vector>
+
+// a NUMA node along with the cpus of it the process may run on
+struct NumaNode {
+  // -1 if the host is taken as a single node, so that memory is placed wherever the kernel sees fit
+  int              id;
+  std::vector<int> cpus;
+};
+
+// nodes with any cpu the process may run on, in order of their ids, as told by sysfs
+//  a host with a single node, or whose topology cannot be read, e.g. as sysfs is not mounted, is taken as a
+//   single node holding every cpu allowed
+auto numa_nodes() -> std::vector<NumaNode>;
+#endif
@@ -0,0 +1,166 @@
+#include "policy.hh"
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <print>
+#include <sstream>
+#include <unistd.h>
+
+static auto parse_permissions(std::string_view text) -> std::optional<uint8_t> {
+  uint8_t result = 0;
+  for (const auto c : text) {
+    switch (c) {
+    case 'r':
+      result |= Policy::Read;
+      break;
+    case 'l':
+      result |= Policy::List;
+      break;
+    case 'w':
+      result |= Policy::Write;
+      break;
+    case 'd':
+      result |= Policy::Delete;
+      break;
+    case 'a':
+      result |= Policy::Admin;
+      break;
+    default:
+      return {};
+    }
+  }
+  return result;
+}
+
+static auto parse_id(std::string_view text) -> std::optional<uint32_t> {
+  uint32_t   result = 0;
+  const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), result);
+  if (error != std::errc() || end != text.data() + text.size()) {
+    return {};
+  }
+  return result;
+}
+
+auto Policy::load(const char *path) -> std::optional<Policy> {
+  std::ifstream file(path);
+  if (!file) {
+    std::println(stderr, "failed to open policy {}", path);
+    return {};
+  }
+  Policy      result;
+  std::string line;
+  size_t      number = 0;
+  while (std::getline(file, line)) {
+    number++;
+    std::istringstream stream(line);
+    std::string        prefix;
+    std::string        subject;
+    std::string        permissions;
+    std::string        rest;
+    if (!(stream >> prefix) || prefix.starts_with('#')) {
+      continue;
+    }
+    stream >> subject >> permissions;
+    const auto parsed_permissions = parse_permissions(permissions);
+    if (subject.empty() || permissions.empty() || (stream >> rest) || !parsed_permissions.has_value()) {
+      std::println(stderr, "{}:{}: expected PREFIX SUBJECT PERMISSIONS", path, number);
+      return {};
+    }
+    Rule rule{prefix == "*" ? "" : prefix, Subject::Anyone, 0, {}, parsed_permissions.value()};
+    const std::string_view view(subject);
+    if (view.starts_with("uid=") || view.starts_with("gid=")) {
+      const auto id = parse_id(view.substr(4));
+      if (!id.has_value()) {
+        std::println(stderr, "{}:{}: invalid id in {}", path, number, subject);
+        return {};
+      }
+      rule.subject = view.starts_with("uid=") ? Subject::User : Subject::Group;
+      rule.id      = id.value();
+    } else if (view.starts_with("exe=")) {
+      rule.subject    = Subject::Executable;
+      rule.executable = view.substr(4);
+    } else if (view != "*") {
+      std::println(stderr, "{}:{}: unknown subject {}", path, number, subject);
+      return {};
+    }
+    result.rules.push_back(std::move(rule));
+  }
+  return result;
+}
+
+auto Policy::compile(const ucred &credentials) const -> Access {
+  Access result;
+  // the executable is only looked up if some rule refers to it
+  std::optional<std::string> executable;
+  for (const auto &rule : this->rules) {
+    bool applies = false;
+    switch (rule.subject) {
+    case Subject::Anyone:
+      applies = true;
+      break;
+    case Subject::User:
+      applies = rule.id == credentials.uid;
+      break;
+    case Subject::Group:
+      applies = rule.id == credentials.gid;
+      break;
+    case Subject::Executable:
+      if (!executable.has_value()) {
+        // the process may have exited or exec'd since connecting, which fails the match or resolves to what
+        //  it runs now, so exe= rules are only as strong as the peer is trusted not to race its own exec
+        char       buffer[4096];
+        const auto link   = std::format("/proc/{}/exe", credentials.pid);
+        const auto length = readlink(link.c_str(), buffer, sizeof(buffer));
+        executable        = length > 0 ? std::string(buffer, length) : std::string();
+      }
+      applies = !executable->empty() && rule.executable == executable.value();
+      break;
+    }
+    if (!applies) {
+      continue;
+    }
+    result.global |= rule.permissions & Admin;
+    auto iterator  = std::ranges::find(result.rules, rule.prefix, &Access::Rule::prefix);
+    if (iterator == result.rules.end()) {
+      result.rules.push_back({rule.prefix, rule.permissions});
+    } else {
+      iterator->permissions |= rule.permissions;
+    }
+  }
+  std::ranges::stable_sort(result.rules, std::ranges::greater(), [](const Access::Rule &rule) {
+    return rule.prefix.size();
+  });
+  return result;
+}
+
+auto Policy::Access::unrestricted() -> Access {
+  Access result;
+  result.rules.push_back({"", All});
+  result.global = All;
+  return result;
+}
+
+auto Policy::Access::allows(uint8_t permissions) const -> bool {
+  return (this->global & permissions) == permissions;
+}
+
+auto Policy::Access::allows(std::string_view key, uint8_t permissions) const -> bool {
+  for (const auto &rule : this->rules) {
+    if (key.starts_with(rule.prefix)) {
+      return (rule.permissions & permissions) == permissions;
+    }
+  }
+  return false;
+}
+
+auto Policy::Access::allows_prefix(std::string_view prefix, uint8_t permissions) const -> bool {
+  // rules more specific than prefix govern some of the keys under it, so they must all grant permissions too
+  for (const auto &rule : this->rules) {
+    if (rule.prefix.size() > prefix.size() && rule.prefix.starts_with(prefix)
+        && (rule.permissions & permissions) != permissions) {
+      return false;
+    }
+  }
+  return this->allows(prefix, permissions);
+}
@@ -0,0 +1,75 @@
+#ifndef POLICY_HH_
+#define POLICY_HH_
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <vector>
+
+// access control over key prefixes based on the credentials of the peer of a connection
+//  a policy file holds one rule per line, empty lines and lines starting with # are ignored:
+//    PREFIX SUBJECT PERMISSIONS
+//  PREFIX  the rule applies to keys starting with it, * for all keys
+//  SUBJECT * for anyone, uid=N, gid=N for the primary group, or exe=PATH for the executable of the peer
+//  PERMISSIONS  any of r (read values), l (list keys), w (write), d (delete) and a (administrate, which is
+//               stats and terminate whatever the prefix is)
+//  a key is governed by the rules with the longest prefix matching it among those applying to the peer,
+//   permissions of all rules with that prefix are combined, and a key no rule applies to is denied
+class Policy {
+public:
+  enum Permission : uint8_t {
+    Read   = 0x01,
+    List   = 0x02,
+    Write  = 0x04,
+    Delete = 0x08,
+    Admin  = 0x10,
+    All    = 0x1f,
+  };
+
+  // decisions of a policy compiled for one peer, checking them makes no syscall and parses nothing
+  class Access {
+  public:
+    // access granting everything, as if no policy were in effect
+    static auto unrestricted() -> Access;
+
+    // permissions not tied to any key
+    [[nodiscard]] auto allows(uint8_t permissions) const -> bool;
+    [[nodiscard]] auto allows(std::string_view key, uint8_t permissions) const -> bool;
+    // whether permissions are granted for every key that may start with prefix
+    [[nodiscard]] auto allows_prefix(std::string_view prefix, uint8_t permissions) const -> bool;
+
+  private:
+    friend class Policy;
+    struct Rule {
+      std::string prefix;
+      uint8_t     permissions;
+    };
+    // sorted by descending length of prefixes, with one rule per prefix
+    std::vector<Rule> rules;
+    uint8_t           global{0};
+  };
+
+  // load a policy file, nothing is returned if it cannot be read or holds an invalid rule
+  static auto load(const char *path) -> std::optional<Policy>;
+
+  // compile the decisions for a peer, which may read the executable of the peer from /proc
+  [[nodiscard]] auto compile(const ucred &credentials) const -> Access;
+
+private:
+  enum class Subject : uint8_t {
+    Anyone,
+    User,
+    Group,
+    Executable,
+  };
+  struct Rule {
+    std::string prefix;
+    Subject     subject;
+    uint32_t    id;
+    std::string executable;
+    uint8_t     permissions;
+  };
+  std::vector<Rule> rules;
+};
+#endif
@@ -0,0 +1,407 @@
+#include "benchmark_client.hh"
+#include "histogram.hh"
+#include "message.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <configuration.hh>
+#include <fcntl.h>
+#include <format>
+#include <memory>
+#include <optional>
+#include <print>
+#include <random>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class Parser : public Configurations {
+public:
+  Parser() {
+    this->add_option("--socket", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--threads", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--duration", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--mix", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--keys", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--key-size", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--value-size", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--channel", Configurations::CommonParsers::true_parser, 0);
+    this->add_option("--ctl", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--json", Configurations::CommonParsers::true_parser, 0);
+  }
+  void help() const override {
+    std::println("secret-storage-bench v{}, load generator for secret-storage server", VERSION);
+    std::println(" This program is part of secret-storage                                         ");
+    std::println("                                                                                ");
+    std::println("Usage: secret-storage-bench [OPTIONS...]                                        ");
+    std::println("OPTIONS:                                                                        ");
+    std::println("  --socket PATH      Specify the path of socket file to connect with server.    ");
+    std::println("                                                                                ");
+    std::println("  --threads N        Number of client threads, 4 by default.                    ");
+    std::println("                                                                                ");
+    std::println("  --duration SECONDS Duration of the measurement, 10 by default.                ");
+    std::println("                                                                                ");
+    std::println("  --mix MIX          Weights of operations, as comma separated list of          ");
+    std::println("                      OPERATION:WEIGHT where OPERATION is one of ping, query,   ");
+    std::println("                      add, delete and cold-get. ping:1,query:7,add:1,delete:1 by");
+    std::println("                      default. A cold-get runs secret-storage-ctl --get on a    ");
+    std::println("                      key, so that its latency includes starting the process.   ");
+    std::println("                                                                                ");
+    std::println("  --keys N           Size of the key space, 1000 by default. All keys are added ");
+    std::println("                      before the measurement starts.                            ");
+    std::println("                                                                                ");
+    std::println("  --key-size SIZE    Size of keys, either a fixed size N or uniformly           ");
+    std::println("                      distributed in a range as MIN-MAX. 32 by default.         ");
+    std::println("                                                                                ");
+    std::println("  --value-size SIZE  Size of values, in the same format as --key-size.          ");
+    std::println("                      64 by default.                                            ");
+    std::println("                                                                                ");
+    std::println("  --channel          Attach a channel in shared memory for each thread and take ");
+    std::println("                      every operation over it instead of a connection each.     ");
+    std::println("                                                                                ");
+    std::println("  --ctl PATH         Path of secret-storage-ctl run by cold-get, looked up in   ");
+    std::println("                      PATH by default.                                          ");
+    std::println("                                                                                ");
+    std::println("  --json             Report in JSON instead of text.                            ");
+  }
+};
+
+enum Operation : uint8_t { Ping, Query, Add, Delete, ColdGet, Operations };
+static constexpr std::array<const char *, Operations> operation_names = {
+  "ping", "query", "add", "delete", "cold-get"
+};
+
+struct SizeDistribution {
+  size_t minimum;
+  size_t maximum;
+
+  static auto parse(const std::string &text) -> SizeDistribution {
+    const auto separator = text.find('-');
+    if (separator == std::string::npos) {
+      const auto size = std::stoul(text);
+      return {size, size};
+    }
+    return {std::stoul(text.substr(0, separator)), std::stoul(text.substr(separator + 1))};
+  }
+  // sizes are derived from a seed so that a key always has the same size
+  [[nodiscard]] auto pick(uint64_t seed) const -> size_t {
+    return this->minimum + seed % (this->maximum - this->minimum + 1);
+  }
+};
+
+struct Options {
+  sockaddr_un                          address;
+  size_t                               threads{4};
+  std::chrono::seconds                 duration{10};
+  std::array<unsigned int, Operations> mix{1, 7, 1, 1, 0};
+  size_t                               keys{1000};
+  SizeDistribution                     key_size{32, 32};
+  SizeDistribution                     value_size{64, 64};
+  bool                                 channel{false};
+  std::string                          ctl{"secret-storage-ctl"};
+};
+
+struct Result {
+  std::array<Histogram, Operations>             latency;
+  std::array<std::atomic<uint64_t>, Operations> errors{};
+};
+
+static auto parse_mix(const std::string &text) -> std::optional<std::array<unsigned int, Operations>> {
+  std::array<unsigned int, Operations> mix{};
+  size_t                               begin = 0;
+  while (begin < text.size()) {
+    auto end = text.find(',', begin);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    const auto entry     = text.substr(begin, end - begin);
+    const auto separator = entry.find(':');
+    if (separator == std::string::npos) {
+      return {};
+    }
+    const auto name = entry.substr(0, separator);
+    size_t     i    = 0;
+    for (; i < Operations; i++) {
+      if (name == operation_names[i]) {
+        break;
+      }
+    }
+    if (i == Operations) {
+      return {};
+    }
+    mix[i] = std::stoul(entry.substr(separator + 1));
+    begin  = end + 1;
+  }
+  return mix;
+}
+
+// keys are generated from their index so that each of them has a stable size
+//  the index is always kept whole, so keys are unique even if they come out longer than the size picked
+static void make_key(std::string &key, size_t index, const SizeDistribution &size) {
+  key = std::format("{:x}/", index);
+  key.resize(std::max(key.size(), size.pick(index * 0x9e3779b97f4a7c15ULL)), '*');
+}
+static void make_value(std::string &value, uint64_t seed, const SizeDistribution &size) {
+  value.assign(size.pick(seed), static_cast<char>('a' + seed % 26));
+}
+
+static void populate(const Options &options) {
+  BenchmarkClient client(options.address);
+  std::string     key;
+  std::string     value;
+  for (size_t i = 0; i < options.keys; i++) {
+    make_key(key, i, options.key_size);
+    make_value(value, i, options.value_size);
+    client.add(key, value, Message::Flags::Add_ReplaceExisting);
+  }
+}
+
+// run secret-storage-ctl --get on key and wait for it to exit, so that the time taken covers everything a
+//  short lived client pays for, from loading the accessor library to tearing the process down
+static auto cold_get(const Options &options, const std::string &key) -> bool {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+  const char *arguments[] = {
+    options.ctl.c_str(), "--socket", options.address.sun_path, "--get", key.c_str(), nullptr
+  };
+  pid_t      child   = -1;
+  const auto spawned =
+    posix_spawnp(&child, options.ctl.c_str(), &actions, nullptr, const_cast<char **>(arguments), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  int status = 0;
+  return spawned == 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void run(const Options &options, Result &result, size_t seed, const std::atomic<bool> &stop) {
+  BenchmarkClient                       client(options.address);
+  std::mt19937_64                       random(seed);
+  std::discrete_distribution<size_t>    pick_operation(options.mix.begin(), options.mix.end());
+  std::uniform_int_distribution<size_t> pick_key(0, options.keys - 1);
+  // latency is recorded locally and merged once finished so threads never contend on the histograms
+  auto        latency = std::make_unique<std::array<Histogram, Operations>>();
+  std::string key;
+  std::string value;
+  if (options.channel && !client.attach()) {
+    std::println(stderr, "failed to attach a channel, falling back to connections");
+  }
+  while (!stop.load(std::memory_order_relaxed)) {
+    const auto operation = static_cast<Operation>(pick_operation(random));
+    make_key(key, pick_key(random), options.key_size);
+    const auto begin     = std::chrono::steady_clock::now();
+    bool       succeeded = false;
+    switch (operation) {
+    case Ping:
+      succeeded = client.ping(options.value_size.pick(random()));
+      break;
+    case Query:
+      succeeded = client.query(key);
+      break;
+    case Add:
+      make_value(value, random(), options.value_size);
+      succeeded = client.add(key, value, Message::Flags::Add_ReplaceExisting);
+      break;
+    case Delete:
+      succeeded = client.remove(key);
+      break;
+    case ColdGet:
+      succeeded = cold_get(options, key);
+      break;
+    default:
+      break;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    if (succeeded) {
+      (*latency)[operation].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    } else {
+      result.errors[operation].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  for (size_t i = 0; i < Operations; i++) {
+    result.latency[i].merge((*latency)[i]);
+  }
+}
+
+static void report_text(const Options &options, const Result &result, double elapsed) {
+  std::println(
+    "{} threads, {:.2f} seconds, {} keys, key size {}-{}, value size {}-{}",
+    options.threads,
+    elapsed,
+    options.keys,
+    options.key_size.minimum,
+    options.key_size.maximum,
+    options.value_size.minimum,
+    options.value_size.maximum
+  );
+  std::println(
+    "{:<10}{:>12}{:>8}{:>14}{:>12}{:>12}{:>12}{:>12}",
+    "operation",
+    "count",
+    "errors",
+    "ops/s",
+    "p50 (us)",
+    "p99 (us)",
+    "p999 (us)",
+    "max (us)"
+  );
+  Histogram total;
+  uint64_t  errors = 0;
+  auto      line   = [&](const char *name, const Histogram &histogram, uint64_t error) {
+    std::println(
+      "{:<10}{:>12}{:>8}{:>14.1f}{:>12.1f}{:>12.1f}{:>12.1f}{:>12.1f}",
+      name,
+      histogram.count(),
+      error,
+      histogram.count() / elapsed,
+      histogram.percentile(50) / 1e3,
+      histogram.percentile(99) / 1e3,
+      histogram.percentile(99.9) / 1e3,
+      histogram.max() / 1e3
+    );
+  };
+  for (size_t i = 0; i < Operations; i++) {
+    const auto error = result.errors[i].load();
+    if (result.latency[i].count() == 0 && error == 0) {
+      continue;
+    }
+    line(operation_names[i], result.latency[i], error);
+    total.merge(result.latency[i]);
+    errors += error;
+  }
+  line("total", total, errors);
+}
+
+static void report_json(const Options &options, const Result &result, double elapsed) {
+  auto object = [&](const Histogram &histogram, uint64_t errors) -> std::string {
+    std::string buckets;
+    histogram.for_each([&](uint64_t value, uint64_t count) {
+      buckets += std::format("{}[{},{}]", buckets.empty() ? "" : ",", value, count);
+    });
+    return std::format(
+      R"({{"count":{},"errors":{},"throughput":{:.1f},"latency_ns":{{"mean":{:.1f},"p50":{},"p99":{},)"
+      R"("p999":{},"max":{},"buckets":[{}]}}}})",
+      histogram.count(),
+      errors,
+      histogram.count() / elapsed,
+      histogram.mean(),
+      histogram.percentile(50),
+      histogram.percentile(99),
+      histogram.percentile(99.9),
+      histogram.max(),
+      buckets
+    );
+  };
+  std::string operations;
+  Histogram   total;
+  uint64_t    errors = 0;
+  for (size_t i = 0; i < Operations; i++) {
+    const auto error = result.errors[i].load();
+    if (result.latency[i].count() == 0 && error == 0) {
+      continue;
+    }
+    operations += std::format(
+      R"({}"{}":{})", operations.empty() ? "" : ",", operation_names[i], object(result.latency[i], error)
+    );
+    total.merge(result.latency[i]);
+    errors += error;
+  }
+  std::println(
+    R"({{"threads":{},"duration":{:.3f},"keys":{},"key_size":[{},{}],"value_size":[{},{}],)"
+    R"("operations":{{{}}},"total":{}}})",
+    options.threads,
+    elapsed,
+    options.keys,
+    options.key_size.minimum,
+    options.key_size.maximum,
+    options.value_size.minimum,
+    options.value_size.maximum,
+    operations,
+    object(total, errors)
+  );
+}
+
+auto main(int argc, char **argv) -> int {
+  auto    configuration = Parser().parse(argc, argv);
+  Options options;
+
+  std::optional<sockaddr_un> address;
+  if (configuration.contains("socket")) {
+    address = make_address(std::any_cast<std::string>(configuration.at("socket")).c_str());
+  } else {
+    address = make_address();
+  }
+  if (!address.has_value()) {
+    std::println(stderr, "cannot use this socket path due to security consideration");
+    return 1;
+  }
+  options.address = address.value();
+  options.channel = configuration.contains("channel");
+  if (configuration.contains("ctl")) {
+    options.ctl = std::any_cast<std::string>(configuration.at("ctl"));
+  }
+  try {
+    if (configuration.contains("threads")) {
+      options.threads = std::stoul(std::any_cast<std::string>(configuration.at("threads")));
+    }
+    if (configuration.contains("duration")) {
+      options.duration =
+        std::chrono::seconds(std::stoul(std::any_cast<std::string>(configuration.at("duration"))));
+    }
+    if (configuration.contains("keys")) {
+      options.keys = std::max<size_t>(std::stoul(std::any_cast<std::string>(configuration.at("keys"))), 1);
+    }
+    if (configuration.contains("key-size")) {
+      options.key_size = SizeDistribution::parse(std::any_cast<std::string>(configuration.at("key-size")));
+    }
+    if (configuration.contains("value-size")) {
+      options.value_size =
+        SizeDistribution::parse(std::any_cast<std::string>(configuration.at("value-size")));
+    }
+    if (configuration.contains("mix")) {
+      auto mix = parse_mix(std::any_cast<std::string>(configuration.at("mix")));
+      if (!mix.has_value() || std::ranges::all_of(mix.value(), [](auto weight) { return weight == 0; })) {
+        std::println(stderr, "invalid operation mix");
+        return 1;
+      }
+      options.mix = mix.value();
+    }
+  } catch (const std::exception &) {
+    std::println(stderr, "invalid numeric argument");
+    return 1;
+  }
+  constexpr size_t limit = MessageBufferSize - sizeof(Message) - sizeof(DoubleEntryBody);
+  if (options.key_size.minimum == 0 || options.key_size.minimum > options.key_size.maximum ||
+      options.value_size.minimum > options.value_size.maximum ||
+      options.key_size.maximum + options.value_size.maximum > limit) {
+    std::println(stderr, "invalid sizes, key and value shall fit into {} bytes together", limit);
+    return 1;
+  }
+
+  populate(options);
+
+  auto                     result = std::make_unique<Result>();
+  std::atomic<bool>        stop{false};
+  std::vector<std::thread> threads;
+  const auto               begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < options.threads; i++) {
+    threads.emplace_back(run, std::cref(options), std::ref(*result), i + 1, std::cref(stop));
+  }
+  std::this_thread::sleep_for(options.duration);
+  stop.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+  if (configuration.contains("json")) {
+    report_json(options, *result, elapsed);
+  } else {
+    report_text(options, *result, elapsed);
+  }
+  return 0;
+}
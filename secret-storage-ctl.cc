@@ -1,6 +1,13 @@
 #include "secret_storage_accessor.hh"
+#include <algorithm>
 #include <configuration.hh>
+#include <cstring>
+#include <fstream>
+#include <iostream>
 #include <print>
+#include <string>
+#include <utility>
+#include <vector>
 
 class Parser : public Configurations {
 public:
@@ -8,11 +15,19 @@ public:
     this->add_option("--socket", Configurations::CommonParsers::identity_parser, 1);
     this->add_option("--ping", Configurations::CommonParsers::true_parser, 0);
     this->add_option("--terminate", Configurations::CommonParsers::true_parser, 0);
+    this->add_option("--stats", Configurations::CommonParsers::true_parser, 0);
     this->add_option("--hex", Configurations::CommonParsers::true_parser, 0);
     this->add_option("--get", Configurations::CommonParsers::identity_parser, 1);
     this->add_option("--check", Configurations::CommonParsers::identity_parser, 1);
     this->add_option("--set", Configurations::CommonParsers::identity_parser, 1);
     this->add_option("--delete", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--list", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--delete-prefix", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--watch", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--replace", Configurations::CommonParsers::true_parser, 0);
+    this->add_option("--evictable", Configurations::CommonParsers::true_parser, 0);
+    this->add_option("--import", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--export", Configurations::CommonParsers::true_parser, 0);
   }
   void help() const override {
     std::println("secret-control-ctl v{}, command line interface to secret-storage server", VERSION);
@@ -26,6 +41,8 @@ public:
     std::println("                                                                                ");
     std::println("  --terminate    Terminate the server.                                          ");
     std::println("                                                                                ");
+    std::println("  --stats        Show statistics of the server.                                 ");
+    std::println("                                                                                ");
     std::println("  --hex          Indicate the KEY specified is base16 encoded.                  ");
     std::println("                                                                                ");
     std::println("  --get    KEY   Get secret value associated with the KEY.                      ");
@@ -35,9 +52,102 @@ public:
     std::println("  --set    KEY   Store a secret to the server. The value is specified via stdin.");
     std::println("                                                                                ");
     std::println("  --delete KEY   Delete secret value associated with the KEY.                   ");
+    std::println("                                                                                ");
+    std::println("  --list PREFIX  List keys starting with PREFIX. Values are never shown.        ");
+    std::println("                  Keys are printed base16 encoded if --hex is specified.        ");
+    std::println("                                                                                ");
+    std::println("  --delete-prefix PREFIX                                                        ");
+    std::println("                 Delete all secrets whose key starts with PREFIX.               ");
+    std::println("                                                                                ");
+    std::println("  --watch PREFIX Print changes of keys starting with PREFIX as they happen until");
+    std::println("                  interrupted. Keys are printed as by --list.                   ");
+    std::println("                                                                                ");
+    std::println("  --replace      Replace existing secrets on --set or --import.                 ");
+    std::println("                                                                                ");
+    std::println("  --evictable    Let the server evict secrets stored on --set or --import to    ");
+    std::println("                  make room for others once it runs short of its quotas.        ");
+    std::println("                                                                                ");
+    std::println("  --import FILE  Store all secrets in FILE, or stdin if FILE is -, to the server");
+    std::println("                  over a single connection. Each line of FILE holds a base16    ");
+    std::println("                  encoded key and value separated by a space.                   ");
+    std::println("                                                                                ");
+    std::println("  --export       Print all secrets on the server in the format of --import.     ");
   }
 };
 
+// number of records submitted at once on import
+static constexpr size_t import_round = 256;
+
+static auto import_secrets(std::istream &input, bool replace, bool evictable) -> int {
+  // keys are decoded into ordinary memory while values are decoded into locked memory
+  //  secrets refers to keys, which never reallocates as it is reserved for a whole round
+  std::vector<std::string>                                   keys;
+  std::vector<std::pair<std::string_view, std::string_view>> secrets;
+  std::string                                                line;
+  size_t                                                     total    = 0;
+  size_t                                                     accepted = 0;
+  size_t                                                     invalid  = 0;
+  keys.reserve(import_round);
+  auto submit = [&]() {
+    accepted += SecretStorageAccessor::submit_secrets(secrets, replace, evictable);
+    total    += secrets.size();
+    for (const auto &[key, value] : secrets) {
+      SecretStorageAccessor::release_secured_string(value);
+    }
+    secrets.clear();
+    keys.clear();
+  };
+  while (std::getline(input, line)) {
+    const auto separator = line.find(' ');
+    if (separator == std::string::npos) {
+      invalid += !line.empty();
+      explicit_bzero(line.data(), line.size());
+      continue;
+    }
+    auto key   = SecretStorageAccessor::decode_string(std::string_view(line).substr(0, separator));
+    auto value = SecretStorageAccessor::decode_secured_string(std::string_view(line).substr(separator + 1));
+    explicit_bzero(line.data(), line.size());
+    if (key.empty() || value.empty()) {
+      invalid++;
+      if (!value.empty()) {
+        SecretStorageAccessor::release_secured_string(value);
+      }
+      continue;
+    }
+    if (keys.size() == import_round) {
+      submit();
+    }
+    keys.push_back(std::move(key));
+    secrets.emplace_back(keys.back(), value);
+  }
+  submit();
+  std::println("--> {} imported, {} failed, {} invalid", accepted, total - accepted, invalid);
+  return 0;
+}
+
+static auto export_secrets() -> int {
+  auto keys = SecretStorageAccessor::list_prefix({});
+  for (size_t offset = 0; offset < keys.size(); offset += import_round) {
+    auto round  = std::span(keys).subspan(offset, std::min(import_round, keys.size() - offset));
+    auto values = SecretStorageAccessor::get_secrets(round);
+    for (size_t i = 0; i < round.size(); i++) {
+      if (values[i].empty()) { // removed since listed
+        continue;
+      }
+      auto key   = SecretStorageAccessor::encode_string(round[i]);
+      auto value = SecretStorageAccessor::encode_string(values[i]);
+      std::println("{} {}", key, value);
+      SecretStorageAccessor::release_secured_string(key);
+      SecretStorageAccessor::release_secured_string(value);
+      SecretStorageAccessor::release_secured_string(values[i]);
+    }
+  }
+  for (const auto &key : keys) {
+    SecretStorageAccessor::release_secured_string(key);
+  }
+  return 0;
+}
+
 auto main(int argc, char **argv) -> int {
   auto options = Parser().parse(argc, argv);
   if (options.contains("socket")) {
@@ -54,6 +164,28 @@ auto main(int argc, char **argv) -> int {
     }
   } else if (options.contains("terminate")) {
     SecretStorageAccessor::terminate_server();
+  } else if (options.contains("stats")) {
+    auto result = SecretStorageAccessor::stats();
+    if (result.empty()) {
+      std::println("--> failed");
+    } else {
+      std::print("{}", result);
+    }
+  } else if (options.contains("import")) {
+    const auto path      = std::any_cast<std::string>(options.at("import"));
+    const bool replace   = options.contains("replace");
+    const bool evictable = options.contains("evictable");
+    if (path == "-") {
+      return import_secrets(std::cin, replace, evictable);
+    }
+    std::ifstream input(path);
+    if (!input) {
+      std::println("cannot open {}", path);
+      return 0;
+    }
+    return import_secrets(input, replace, evictable);
+  } else if (options.contains("export")) {
+    return export_secrets();
   } else {
     bool        hex = options.contains("hex");
     std::string key;
@@ -65,6 +197,12 @@ auto main(int argc, char **argv) -> int {
       key = std::any_cast<std::string>(options.at("set"));
     } else if (options.contains("delete")) {
       key = std::any_cast<std::string>(options.at("delete"));
+    } else if (options.contains("list")) {
+      key = std::any_cast<std::string>(options.at("list"));
+    } else if (options.contains("delete-prefix")) {
+      key = std::any_cast<std::string>(options.at("delete-prefix"));
+    } else if (options.contains("watch")) {
+      key = std::any_cast<std::string>(options.at("watch"));
     }
     if (hex) {
       key = SecretStorageAccessor::decode_string(key);
@@ -87,7 +225,9 @@ auto main(int argc, char **argv) -> int {
       }
     } else if (options.contains("set")) {
       auto result  = SecretStorageAccessor::ask_secret("Enter secret value");
-      auto succeed = SecretStorageAccessor::submit_secret(key, result);
+      auto succeed = SecretStorageAccessor::submit_secret(
+        key, result, options.contains("replace"), options.contains("evictable")
+      );
       SecretStorageAccessor::release_secured_string(result);
       if (succeed) {
         std::println("--> ok");
@@ -101,6 +241,45 @@ auto main(int argc, char **argv) -> int {
       } else {
         std::println("--> failed");
       }
+    } else if (options.contains("list")) {
+      for (const auto &entry : SecretStorageAccessor::list_prefix(key)) {
+        if (hex) {
+          auto encoded = SecretStorageAccessor::encode_string(entry);
+          std::println("--> {}", encoded);
+          SecretStorageAccessor::release_secured_string(encoded);
+        } else {
+          std::println("--> {}", entry);
+        }
+        SecretStorageAccessor::release_secured_string(entry);
+      }
+    } else if (options.contains("delete-prefix")) {
+      auto result = SecretStorageAccessor::remove_prefix(key);
+      if (result.has_value()) {
+        std::println("--> {} deleted", result.value());
+      } else {
+        std::println("--> failed");
+      }
+    } else if (options.contains("watch")) {
+      static constexpr const char *names[] = {"added", "replaced", "deleted", "expired", "evicted"};
+      const std::string_view       prefix(key);
+      const int                    watch = SecretStorageAccessor::watch({}, {&prefix, 1});
+      if (watch == -1) {
+        std::println("--> failed");
+        return 0;
+      }
+      while (auto event = SecretStorageAccessor::next_event(watch)) {
+        const auto &[kind, changed] = event.value();
+        if (hex) {
+          auto encoded = SecretStorageAccessor::encode_string(changed);
+          std::println("--> {} {}", names[static_cast<size_t>(kind)], encoded);
+          SecretStorageAccessor::release_secured_string(encoded);
+        } else {
+          std::println("--> {} {}", names[static_cast<size_t>(kind)], changed);
+        }
+        // events are printed as they come even if the output is not a terminal
+        fflush(stdout);
+      }
+      SecretStorageAccessor::unwatch(watch);
     }
   }
   return 0;
@@ -0,0 +1,369 @@
+#include "benchmark_client.hh"
+#include "capture.hh"
+#include "histogram.hh"
+#include "message.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <configuration.hh>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <print>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+class Parser : public Configurations {
+public:
+  Parser() {
+    this->add_option("--socket", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--capture", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--speed", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--threads", Configurations::CommonParsers::identity_parser, 1);
+    this->add_option("--populate", Configurations::CommonParsers::true_parser, 0);
+    this->add_option("--json", Configurations::CommonParsers::true_parser, 0);
+  }
+  void help() const override {
+    std::println("secret-storage-replay v{}, replays a capture against a secret-storage server", VERSION);
+    std::println(" This program is part of secret-storage                                         ");
+    std::println("                                                                                ");
+    std::println("Usage: secret-storage-replay --capture PATH [OPTIONS...]                        ");
+    std::println("OPTIONS:                                                                        ");
+    std::println("  --socket PATH      Specify the path of socket file to connect with server.    ");
+    std::println("                                                                                ");
+    std::println("  --capture PATH     Capture written by secret-storage --capture to replay.     ");
+    std::println("                      Keys are made up from their hashes in the capture with the");
+    std::println("                      sizes captured, so that a key is always replayed as the   ");
+    std::println("                      same one, and values are filled up to the sizes captured. ");
+    std::println("                                                                                ");
+    std::println("  --speed FACTOR     Send requests FACTOR times as fast as they were captured,  ");
+    std::println("                      1 by default, or as fast as possible if 0.                ");
+    std::println("                                                                                ");
+    std::println("  --threads N        Number of client threads, 4 by default. Requests of a      ");
+    std::println("                      connection are all sent by the same thread in order.      ");
+    std::println("                                                                                ");
+    std::println("  --populate         Add every key read or deleted in the capture before it is  ");
+    std::println("                      added first, so that such requests find it as they did.   ");
+    std::println("                                                                                ");
+    std::println("  --json             Report in JSON instead of text.                            ");
+    std::println("                                                                                ");
+    std::println(" Only ping, add, query and delete requests are replayed, others are skipped.    ");
+  }
+};
+
+enum Operation : uint8_t { Ping, Query, Add, Delete, Operations };
+static constexpr std::array<const char *, Operations> operation_names = {"ping", "query", "add", "delete"};
+
+// size of a value added by --populate for a key whose value was never seen in the capture
+static constexpr size_t DefaultValueSize = 64;
+
+struct Options {
+  sockaddr_un address;
+  std::string capture;
+  double      speed{1};
+  size_t      threads{4};
+  bool        populate{false};
+};
+
+struct Result {
+  std::array<Histogram, Operations>             latency;
+  std::array<std::atomic<uint64_t>, Operations> errors{};
+  // requests that failed where they succeeded in the capture, or the other way around
+  std::array<std::atomic<uint64_t>, Operations> diverged{};
+  // how late requests were sent compared to when they are due at the speed asked for
+  Histogram             lag;
+  std::atomic<uint64_t> skipped{0};
+};
+
+static auto operation_of(uint8_t type) -> std::optional<Operation> {
+  if (type == Message::Type::Ping) {
+    return Ping;
+  } else if (type == Message::Type::Query) {
+    return Query;
+  } else if (type == Message::Type::Add) {
+    return Add;
+  } else if (type == Message::Type::Delete) {
+    return Delete;
+  }
+  return {};
+}
+
+static auto load(const std::string &path) -> std::optional<std::vector<Capture::Record>> {
+  std::ifstream   input(path, std::ios::binary);
+  Capture::Header header{};
+  if (!input.read(reinterpret_cast<char *>(&header), sizeof(header))
+      || memcmp(header.magic, Capture::Magic, sizeof(Capture::Magic)) != 0
+      || header.record_size != sizeof(Capture::Record)) {
+    return {};
+  }
+  std::vector<Capture::Record> records;
+  Capture::Record              record;
+  // a record cut short, e.g. as the server was killed while writing it, is ignored
+  while (input.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    records.push_back(record);
+  }
+  return records;
+}
+
+// keys are made up from their hashes, only part of which is kept in keys shorter than 16 bytes, so that
+//  distinct keys may be replayed as the same one then
+static void make_key(std::string &key, uint64_t hash, size_t size) {
+  key = std::format("{:016x}", hash);
+  key.resize(size, '*');
+}
+static void make_value(std::string &value, uint64_t seed, size_t size) {
+  value.assign(size, static_cast<char>('a' + seed % 26));
+}
+
+static void populate(const Options &options, const std::vector<Capture::Record> &records) {
+  BenchmarkClient              client(options.address);
+  std::unordered_set<uint64_t> seen;
+  std::string                  key;
+  std::string                  value;
+  // room for the key and the value of an add, a key too long to be added with any value is left missing
+  constexpr size_t Room = MessageBufferSize - sizeof(Message) - sizeof(DoubleEntryBody);
+  for (const auto &record : records) {
+    const auto operation = operation_of(record.type);
+    if (!operation.has_value() || operation == Ping || !seen.insert(record.key).second) {
+      continue;
+    }
+    if ((operation == Query || operation == Delete) && !record.failed && record.key_size < Room) {
+      make_key(key, record.key, record.key_size);
+      // the size is only captured for queries returning a value, the default one is cut down to what fits
+      const size_t size = record.value_size != 0 ? record.value_size : DefaultValueSize;
+      make_value(value, record.key, std::min(size, Room - record.key_size));
+      client.add(key, value, Message::Flags::Add_ReplaceExisting);
+    }
+  }
+}
+
+static void replay(
+  const Options                        &options,
+  const std::vector<Capture::Record>   &records,
+  size_t                                worker,
+  std::chrono::steady_clock::time_point start,
+  Result                               &result
+) {
+  BenchmarkClient client(options.address);
+  // latency is recorded locally and merged once finished so threads never contend on the histograms
+  auto        latency = std::make_unique<std::array<Histogram, Operations>>();
+  auto        lag     = std::make_unique<Histogram>();
+  std::string key;
+  std::string value;
+  for (const auto &record : records) {
+    if (record.connection % options.threads != worker) {
+      continue;
+    }
+    const auto operation = operation_of(record.type);
+    if (!operation.has_value()) {
+      result.skipped.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    if (options.speed > 0) {
+      const auto offset = static_cast<double>(record.time) / options.speed;
+      const auto due    = start + std::chrono::nanoseconds(static_cast<uint64_t>(offset));
+      std::this_thread::sleep_until(due);
+      lag->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - due)
+                    .count());
+    }
+    make_key(key, record.key, record.key_size);
+    const auto begin     = std::chrono::steady_clock::now();
+    bool       succeeded = false;
+    switch (operation.value()) {
+    case Ping:
+      succeeded = client.ping(record.value_size);
+      break;
+    case Query:
+      succeeded = client.query(key, record.flags);
+      break;
+    case Add:
+      make_value(value, record.time, record.value_size);
+      succeeded = client.add(key, value, record.flags);
+      break;
+    case Delete:
+      succeeded = client.remove(key, record.flags);
+      break;
+    default:
+      break;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    if (!succeeded) {
+      result.errors[operation.value()].fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    (*latency)[operation.value()].record(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()
+    );
+    if (client.failed() != static_cast<bool>(record.failed)) {
+      result.diverged[operation.value()].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  for (size_t i = 0; i < Operations; i++) {
+    result.latency[i].merge((*latency)[i]);
+  }
+  result.lag.merge(*lag);
+}
+
+static void report_text(
+  const Options &options, const Result &result, size_t captured, double span, double elapsed
+) {
+  std::println(
+    "{} requests captured over {:.2f} seconds, replayed in {:.2f} seconds with {} threads, {} skipped",
+    captured,
+    span,
+    elapsed,
+    options.threads,
+    result.skipped.load()
+  );
+  std::println(
+    "{:<10}{:>12}{:>8}{:>10}{:>14}{:>12}{:>12}{:>12}",
+    "operation",
+    "count",
+    "errors",
+    "diverged",
+    "ops/s",
+    "p50 (us)",
+    "p99 (us)",
+    "max (us)"
+  );
+  for (size_t i = 0; i < Operations; i++) {
+    const auto &histogram = result.latency[i];
+    const auto  errors    = result.errors[i].load();
+    if (histogram.count() == 0 && errors == 0) {
+      continue;
+    }
+    std::println(
+      "{:<10}{:>12}{:>8}{:>10}{:>14.1f}{:>12.1f}{:>12.1f}{:>12.1f}",
+      operation_names[i],
+      histogram.count(),
+      errors,
+      result.diverged[i].load(),
+      histogram.count() / elapsed,
+      histogram.percentile(50) / 1e3,
+      histogram.percentile(99) / 1e3,
+      histogram.max() / 1e3
+    );
+  }
+  if (result.lag.count() != 0) {
+    std::println(
+      "lag behind schedule (us): p50 {:.1f}, p99 {:.1f}, max {:.1f}",
+      result.lag.percentile(50) / 1e3,
+      result.lag.percentile(99) / 1e3,
+      result.lag.max() / 1e3
+    );
+  }
+}
+
+static void report_json(
+  const Options &options, const Result &result, size_t captured, double span, double elapsed
+) {
+  std::string operations;
+  for (size_t i = 0; i < Operations; i++) {
+    const auto &histogram = result.latency[i];
+    const auto  errors    = result.errors[i].load();
+    if (histogram.count() == 0 && errors == 0) {
+      continue;
+    }
+    operations += std::format(
+      R"({}"{}":{{"count":{},"errors":{},"diverged":{},"throughput":{:.1f},"latency_ns":{{"mean":{:.1f},)"
+      R"("p50":{},"p99":{},"p999":{},"max":{}}}}})",
+      operations.empty() ? "" : ",",
+      operation_names[i],
+      histogram.count(),
+      errors,
+      result.diverged[i].load(),
+      histogram.count() / elapsed,
+      histogram.mean(),
+      histogram.percentile(50),
+      histogram.percentile(99),
+      histogram.percentile(99.9),
+      histogram.max()
+    );
+  }
+  std::println(
+    R"({{"captured":{},"span":{:.3f},"duration":{:.3f},"threads":{},"speed":{},"skipped":{},)"
+    R"("operations":{{{}}},"lag_ns":{{"p50":{},"p99":{},"max":{}}}}})",
+    captured,
+    span,
+    elapsed,
+    options.threads,
+    options.speed,
+    result.skipped.load(),
+    operations,
+    result.lag.percentile(50),
+    result.lag.percentile(99),
+    result.lag.max()
+  );
+}
+
+auto main(int argc, char **argv) -> int {
+  auto    configuration = Parser().parse(argc, argv);
+  Options options;
+
+  std::optional<sockaddr_un> address;
+  if (configuration.contains("socket")) {
+    address = make_address(std::any_cast<std::string>(configuration.at("socket")).c_str());
+  } else {
+    address = make_address();
+  }
+  if (!address.has_value()) {
+    std::println(stderr, "cannot use this socket path due to security consideration");
+    return 1;
+  }
+  options.address  = address.value();
+  options.populate = configuration.contains("populate");
+  if (!configuration.contains("capture")) {
+    std::println(stderr, "no capture to replay given");
+    return 1;
+  }
+  options.capture = std::any_cast<std::string>(configuration.at("capture"));
+  try {
+    if (configuration.contains("speed")) {
+      options.speed = std::stod(std::any_cast<std::string>(configuration.at("speed")));
+    }
+    if (configuration.contains("threads")) {
+      options.threads =
+        std::max<size_t>(std::stoul(std::any_cast<std::string>(configuration.at("threads"))), 1);
+    }
+  } catch (const std::exception &) {
+    std::println(stderr, "invalid numeric argument");
+    return 1;
+  }
+  if (options.speed < 0) {
+    std::println(stderr, "invalid speed");
+    return 1;
+  }
+
+  const auto records = load(options.capture);
+  if (!records.has_value()) {
+    std::println(stderr, "cannot read capture {}", options.capture);
+    return 1;
+  }
+  if (options.populate) {
+    populate(options, records.value());
+  }
+
+  auto                     result = std::make_unique<Result>();
+  std::vector<std::thread> threads;
+  const auto               begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < options.threads; i++) {
+    threads.emplace_back(replay, std::cref(options), std::cref(records.value()), i, begin, std::ref(*result));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  const auto span    = records->empty() ? 0 : records->back().time / 1e9;
+
+  if (configuration.contains("json")) {
+    report_json(options, *result, records->size(), span, elapsed);
+  } else {
+    report_text(options, *result, records->size(), span, elapsed);
+  }
+  return 0;
+}
@@ -1,23 +1,54 @@
 #include "secret_storage_accessor.hh"
+#include "channel.hh"
+#include "codec.hh"
 #include "hardened_memory_allocator.hh"
 #include "message.hh"
+#include "secure_random.hh"
 #include "utility.hh"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <list>
+#include <poll.h>
 #include <print>
 #include <stdexcept>
-#include <sys/random.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <thread>
 #include <vector>
 
-static bool                                                   initialized = false;
-static std::vector<uint8_t, HardenedMemoryAllocator<uint8_t>> input_buffer(2000);
-static std::vector<uint8_t, HardenedMemoryAllocator<uint8_t>> output_buffer(2000);
-static Message    *input_message  = reinterpret_cast<Message *>(input_buffer.data());
-static Message    *output_message = reinterpret_cast<Message *>(output_buffer.data());
-static sockaddr_un address;
+static bool initialized = false;
+// sockets of the reactors of the server, the first one being the socket path itself
+static std::vector<sockaddr_un> addresses;
+// channel attached, and the connection keeping it open
+static Channel *channel        = nullptr;
+static int      channel_socket = -1;
+
+// buffers of the message sent and the one received, allocated on first use, so that merely loading the
+//  library, e.g. importing the python module, maps and locks nothing
+//  both share a single allocation, which takes a single locked page
+class MessageBuffers final {
+public:
+  explicit MessageBuffers(size_t count = 2)
+    : data(static_cast<uint8_t *>(HardenedMemoryManager::allocate(MessageBufferSize * count))) {}
+  MessageBuffers(const MessageBuffers &)                     = delete;
+  auto operator=(const MessageBuffers &) -> MessageBuffers & = delete;
+  ~MessageBuffers() { HardenedMemoryManager::deallocate(this->data); }
+
+  uint8_t *const data;
+};
+static auto message_buffers() -> uint8_t * {
+  static MessageBuffers buffers;
+  return buffers.data;
+}
+static auto output_message() -> Message * { return reinterpret_cast<Message *>(message_buffers()); }
+static auto input_message() -> Message * {
+  return reinterpret_cast<Message *>(message_buffers() + MessageBufferSize);
+}
 
 static std::list<secured_string>                                           secrets;
 static std::unordered_map<const char *, decltype(secrets)::const_iterator> secrets_map;
@@ -28,27 +59,182 @@ static auto view_wrapper(secured_string &&string) -> std::string_view {
   return {secrets.front().data(), secrets.front().size()};
 }
 
+// attempts of a request rejected as busy, the backoff doubling after each of them
+static constexpr int  busy_attempts = 6;
+static constexpr auto busy_backoff  = std::chrono::milliseconds(2);
+
+// peek at the reply for a busy rejection and return how long the server asks to wait before retrying,
+//  leaving any other reply to the caller
+static auto busy_hint(int socket_fd) -> std::optional<std::chrono::milliseconds> {
+  uint8_t     buffer[sizeof(Message) + sizeof(SingleEntryBody) + 64];
+  auto *const message = reinterpret_cast<Message *>(buffer);
+  if (!peek_header(socket_fd, message) || message->type != Message::Type::Failed
+      || !(message->flags & Message::Flags::Failed_Busy)) {
+    return {};
+  }
+  // the rejection is sent at once, so it is complete as soon as its header arrived, or else it is retried
+  //  right away
+  const auto  received = recv(socket_fd, buffer, sizeof(buffer), MSG_PEEK);
+  auto *const body     = reinterpret_cast<SingleEntryBody *>(message->data);
+  if (received < static_cast<ssize_t>(sizeof(Message) + sizeof(SingleEntryBody))
+      || received < static_cast<ssize_t>(sizeof(Message) + sizeof(SingleEntryBody) + body->length)) {
+    return std::chrono::milliseconds(0);
+  }
+  const std::string_view text(reinterpret_cast<const char *>(body->data), body->length);
+  const auto             digits = text.find_first_of("0123456789");
+  uint32_t               wait   = 0;
+  if (digits != std::string_view::npos) {
+    std::from_chars(text.data() + digits, text.data() + text.size(), wait);
+  }
+  return std::chrono::milliseconds(wait);
+}
+
+// socket of the reactor owning the key of a request on a single key, so that it is served from the partition
+//  of the storage of that reactor, and of the first reactor for anything else
+//  a request sent to another reactor is still served, only at the cost of contending for the partition
+static auto route(const Message *message) -> const sockaddr_un & {
+  if (addresses.size() == 1) {
+    return addresses.front();
+  }
+  std::string_view key;
+  if (message->type == Message::Type::Add) {
+    const auto *const body = reinterpret_cast<const DoubleEntryBody *>(message->data);
+    key                    = {reinterpret_cast<const char *>(body->data), body->length[0]};
+  } else if (message->type == Message::Type::Query || message->type == Message::Type::Delete) {
+    const auto *const body = reinterpret_cast<const SingleEntryBody *>(message->data);
+    key                    = {reinterpret_cast<const char *>(body->data), body->length};
+  } else {
+    return addresses.front();
+  }
+  return addresses[partition_of(SecuredStringHash{}(key), addresses.size())];
+}
+
 static auto send_message(void *data, size_t length) -> int {
   if (!initialized) {
     if (!SecretStorageAccessor::set_socket_path()) {
       return -1;
     }
   }
-  int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (socket_fd == -1) {
-    return -1;
-  }
-  ssize_t return_value = connect(socket_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
-  if (return_value == -1) {
+  // replies to a batch only come after all of its messages are sent, so a batch is not retried here and a
+  //  busy rejection of it fails the whole batch instead
+  const bool retriable = reinterpret_cast<Message *>(data)->type != Message::Type::Batch;
+  const auto &address   = route(reinterpret_cast<Message *>(data));
+  auto       backoff   = std::chrono::duration_cast<std::chrono::microseconds>(busy_backoff);
+  for (int attempt = 1;; attempt++) {
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd == -1) {
+      return -1;
+    }
+    ssize_t return_value = connect(socket_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    if (return_value == -1) {
+      close(socket_fd);
+      return -1;
+    }
+    // a connection rejected before the request is sent fails sending, while the rejection is still readable
+    return_value    = send(socket_fd, data, length, MSG_NOSIGNAL);
+    const bool sent = static_cast<size_t>(return_value) == length;
+    std::optional<std::chrono::milliseconds> wait;
+    if (retriable && attempt < busy_attempts) {
+      wait = busy_hint(socket_fd);
+    }
+    if (!wait.has_value()) {
+      if (!sent) {
+        close(socket_fd);
+        return -1;
+      }
+      return socket_fd;
+    }
     close(socket_fd);
-    return -1;
+    // a random share of the backoff on top of the hint, so that clients rejected together do not come
+    //  back together
+    uint32_t random;
+    SecureRandom::fill(&random, sizeof(random));
+    std::this_thread::sleep_for(wait.value() + backoff * random / (uint64_t(1) << 32));
+    backoff *= 2;
   }
-  return_value = send(socket_fd, data, length, MSG_NOSIGNAL);
-  if (static_cast<size_t>(return_value) != length) {
-    close(socket_fd);
-    return -1;
+}
+
+static auto send_all(int socket_fd, const void *data, size_t length) -> bool {
+  const auto *pointer = reinterpret_cast<const uint8_t *>(data);
+  while (length != 0) {
+    auto sent = send(socket_fd, pointer, length, MSG_NOSIGNAL);
+    if (sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    pointer += sent;
+    length  -= sent;
   }
-  return socket_fd;
+  return true;
+}
+
+// put a request into the channel and wait for its reply, detaching the channel if the server is gone
+static auto exchange(size_t length) -> bool {
+  const auto seen = channel->reply.sequence.load(std::memory_order_acquire);
+  memcpy(channel->request.data, output_message(), length);
+  channel->request.post(length);
+  while (!channel->reply.wait(seen)) {
+    // the server sends nothing over the connection, so anything on it is a hang up
+    pollfd descriptor{channel_socket, POLLIN, 0};
+    if (poll(&descriptor, 1, 0) != 0) {
+      SecretStorageAccessor::detach();
+      return false;
+    }
+  }
+  memcpy(input_message(), channel->reply.data, std::min<size_t>(channel->reply.length, MessageBufferSize));
+  return true;
+}
+
+// send a self contained request of length built in output_message() and receive its whole reply into
+//  input_message(), over the channel if one is attached, or over a connection of its own otherwise
+static auto request(size_t length) -> bool {
+  if (channel != nullptr) {
+    return exchange(length);
+  }
+  const int socket_fd = send_message(output_message(), length);
+  if (socket_fd == -1) {
+    return false;
+  }
+  MessageReceiver receiver(socket_fd, input_message());
+  const bool      result = receiver.receive();
+  close(socket_fd);
+  return result;
+}
+
+// number of requests sent before waiting for their replies in a batch
+//  replies of a whole round must fit into the socket buffer, or the server blocks on sending them
+static constexpr size_t batch_round = 32;
+
+using secured_buffer = std::vector<uint8_t, HardenedMemoryAllocator<uint8_t>>;
+
+// flags of an Add request
+static auto add_flags(bool replace, bool evictable) -> uint8_t {
+  return (replace ? Message::Flags::Add_ReplaceExisting : 0)
+         | (evictable ? Message::Flags::Add_Evictable : 0);
+}
+
+// append a message to buffer and return its body
+template <typename Body>
+static auto append_message(secured_buffer &buffer, Message::Type type, uint8_t flags, size_t length)
+  -> Body * {
+  const auto offset = buffer.size();
+  buffer.resize(offset + sizeof(Message) + sizeof(Body) + length);
+  auto *const message = reinterpret_cast<Message *>(buffer.data() + offset);
+  message->type       = type;
+  message->flags      = flags;
+  return reinterpret_cast<Body *>(message->data);
+}
+
+// open a connection and announce a batch of count messages on it
+static auto start_batch(uint32_t count) -> int {
+  output_message()->type  = Message::Type::Batch;
+  output_message()->flags = 0;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = sizeof(count);
+  memcpy(body->data, &count, sizeof(count));
+  return send_message(output_message(), sizeof(Message) + sizeof(SingleEntryBody) + body->length);
 }
 
 void SecretStorageAccessor::release_secured_string(std::string_view string) {
@@ -58,34 +244,85 @@ void SecretStorageAccessor::release_secured_string(std::string_view string) {
 
 auto SecretStorageAccessor::make_secured_key(size_t length) -> std::string_view {
   secured_string buffer(length, '\0');
-  getrandom(buffer.data(), length, 0);
+  SecureRandom::fill(buffer.data(), length);
   return view_wrapper(std::move(buffer));
 }
 
-static inline auto to_hex(char c) -> char { return static_cast<char>(c > 9 ? c - 10 + 'A' : c + '0'); }
-static inline auto from_hex(char c) -> uint8_t { return c >= '0' && c <= '9' ? c - '0' : c - 'A' + 10; }
+auto SecretStorageAccessor::make_secured_keys(size_t count, size_t length) -> std::vector<std::string_view> {
+  // drawn at once into locked memory, then split, as each key is released on its own
+  secured_string pool(count * length, '\0');
+  SecureRandom::fill(pool.data(), pool.size());
+  std::vector<std::string_view> result;
+  result.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    result.push_back(view_wrapper(secured_string(pool.data() + i * length, length)));
+  }
+  return result;
+}
 
 auto SecretStorageAccessor::encode_string(std::string_view string) -> std::string_view {
   secured_string result(string.size() * 2, '\0');
-  for (size_t i = 0; i < string.size(); i++) {
-    auto c               = static_cast<uint8_t>(string[i]);
-    result[i << 1]       = to_hex(static_cast<char>(c >> 4));
-    result[(i << 1) | 1] = to_hex(static_cast<char>(c & 0xf));
-  }
+  Codec::hex_encode(reinterpret_cast<const uint8_t *>(string.data()), string.size(), result.data());
   return view_wrapper(std::move(result));
 }
 
-auto SecretStorageAccessor::decode_string(std::string_view string) -> std::string {
+// decode base16 into a string of either allocator, empty if string is not a valid encoding
+template <typename String>
+static auto decode_hex(std::string_view string) -> String {
   if (string.size() & 1) {
     return {};
   }
-  std::string result(string.size() >> 1, '\0');
-  for (size_t i = 0; i < result.size(); i++) {
-    result[i] = static_cast<char>((from_hex(string[i << 1]) << 4) | from_hex(string[(i << 1) | 1]));
+  String result(string.size() >> 1, '\0');
+  if (!Codec::hex_decode(string.data(), result.size(), reinterpret_cast<uint8_t *>(result.data()))) {
+    return {};
   }
   return result;
 }
 
+auto SecretStorageAccessor::decode_string(std::string_view string) -> std::string {
+  return decode_hex<std::string>(string);
+}
+
+auto SecretStorageAccessor::decode_secured_string(std::string_view string) -> std::string_view {
+  auto result = decode_hex<secured_string>(string);
+  if (result.empty()) {
+    return {};
+  }
+  return view_wrapper(std::move(result));
+}
+
+auto SecretStorageAccessor::encode_base64(std::string_view string) -> std::string_view {
+  secured_string result(Codec::base64_encoded_size(string.size()), '\0');
+  Codec::base64_encode(reinterpret_cast<const uint8_t *>(string.data()), string.size(), result.data());
+  return view_wrapper(std::move(result));
+}
+
+// decode base64 into a string of either allocator, empty if string is not a valid encoding
+template <typename String>
+static auto decode_base64(std::string_view string) -> String {
+  const auto size = Codec::base64_decoded_size(string.data(), string.size());
+  if (!size.has_value()) {
+    return {};
+  }
+  String result(size.value(), '\0');
+  if (!Codec::base64_decode(string.data(), string.size(), reinterpret_cast<uint8_t *>(result.data()))) {
+    return {};
+  }
+  return result;
+}
+
+auto SecretStorageAccessor::decode_base64(std::string_view string) -> std::string {
+  return ::decode_base64<std::string>(string);
+}
+
+auto SecretStorageAccessor::decode_secured_base64(std::string_view string) -> std::string_view {
+  auto result = ::decode_base64<secured_string>(string);
+  if (result.empty()) {
+    return {};
+  }
+  return view_wrapper(std::move(result));
+}
+
 auto SecretStorageAccessor::ask_secret(const char *prompt, const char *retry_prompt) -> std::string_view {
   auto result = ::ask_secret<secured_string::allocator_type>(prompt, retry_prompt);
   return view_wrapper(std::move(result));
@@ -93,32 +330,36 @@ auto SecretStorageAccessor::ask_secret(const char *prompt, const char *retry_pro
 
 auto SecretStorageAccessor::set_socket_path(const char *socket_path) -> bool {
   auto result = make_address(socket_path);
-  if (result.has_value()) {
-    address     = result.value();
-    initialized = true;
-    return true;
+  if (!result.has_value()) {
+    return false;
+  }
+  // a channel belongs to the server found at the previous path
+  SecretStorageAccessor::detach();
+  // a server with several reactors has a socket for each of them next to the first one
+  addresses.assign(1, result.value());
+  while (true) {
+    const auto next = reactor_address(result.value(), addresses.size());
+    struct stat status;
+    if (!next.has_value() || ::stat(next->sun_path, &status) == -1 || !S_ISSOCK(status.st_mode)) {
+      break;
+    }
+    addresses.push_back(next.value());
   }
-  return false;
+  initialized = true;
+  return true;
 }
 
 auto SecretStorageAccessor::ping() -> bool {
-  output_message->type  = Message::Type::Ping;
-  output_message->flags = 0;
-  auto *const body      = reinterpret_cast<SingleEntryBody *>(output_message->data);
-  body->length          = 128;
-  getrandom(body->data, body->length, 0);
-  int socket_fd = send_message(output_message, sizeof(Message) + sizeof(SingleEntryBody) + body->length);
-  if (socket_fd == -1) {
+  output_message()->type  = Message::Type::Ping;
+  output_message()->flags = 0;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = 128;
+  SecureRandom::fill(body->data, body->length);
+  if (!request(sizeof(Message) + sizeof(SingleEntryBody) + body->length)
+      || input_message()->type != Message::Type::Pong) {
     return false;
   }
-  recv(socket_fd, input_message, sizeof(Message), MSG_WAITALL);
-  if (input_message->type != Message::Type::Pong) {
-    close(socket_fd);
-    return false;
-  }
-  auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message->data);
-  input_body->receive(socket_fd);
-  close(socket_fd);
+  auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message()->data);
   if (input_body->length != body->length) {
     return false;
   }
@@ -126,93 +367,351 @@ auto SecretStorageAccessor::ping() -> bool {
 }
 
 auto SecretStorageAccessor::exists(std::string_view key) -> bool {
-  output_message->type  = Message::Type::Query;
-  output_message->flags = Message::Flags::Query_ExistenceOnly;
-  auto *const body      = reinterpret_cast<SingleEntryBody *>(output_message->data);
-  body->length          = key.size();
+  output_message()->type  = Message::Type::Query;
+  output_message()->flags = Message::Flags::Query_ExistenceOnly;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = key.size();
   memcpy(body->data, key.data(), key.size());
-  int socket_fd = send_message(output_message, sizeof(Message) + sizeof(SingleEntryBody) + body->length);
-  if (socket_fd == -1) {
+  if (!request(sizeof(Message) + sizeof(SingleEntryBody) + body->length)) {
     return false;
   }
-  recv(socket_fd, input_message, sizeof(Message), MSG_WAITALL);
-  close(socket_fd);
-  if (input_message->type == Message::Type::Ok) {
+  if (input_message()->type == Message::Type::Ok) {
     return true;
-  } else if (input_message->type == Message::Type::Failed) {
+  } else if (input_message()->type == Message::Type::Failed) {
     return false;
   }
   throw std::logic_error("shall not reach here");
 }
 
-auto SecretStorageAccessor::submit_secret(std::string_view key, std::string_view value, bool replace)
-  -> bool {
-  output_message->type  = Message::Type::Add;
-  output_message->flags = replace ? Message::Flags::Add_ReplaceExisting : 0;
-  auto *const body      = reinterpret_cast<DoubleEntryBody *>(output_message->data);
-  body->length[0]       = key.size();
-  body->length[1]       = value.size();
+auto SecretStorageAccessor::submit_secret(
+  std::string_view key, std::string_view value, bool replace, bool evictable
+) -> bool {
+  output_message()->type  = Message::Type::Add;
+  output_message()->flags = add_flags(replace, evictable);
+  auto *const body        = reinterpret_cast<DoubleEntryBody *>(output_message()->data);
+  body->length[0]         = key.size();
+  body->length[1]         = value.size();
   memcpy(body->data, key.data(), key.size());
   memcpy(body->data + key.size(), value.data(), value.size());
-  int socket_fd = send_message(
-    output_message, sizeof(Message) + sizeof(DoubleEntryBody) + body->length[0] + body->length[1]
-  );
-  if (socket_fd == -1) {
+  if (!request(sizeof(Message) + sizeof(DoubleEntryBody) + body->length[0] + body->length[1])) {
     return false;
   }
-  recv(socket_fd, input_message, sizeof(Message), MSG_WAITALL);
-  close(socket_fd);
-  if (input_message->type == Message::Type::Ok) {
+  if (input_message()->type == Message::Type::Ok) {
     return true;
-  } else if (input_message->type == Message::Type::Failed) {
+  } else if (input_message()->type == Message::Type::Failed) {
     return false;
   }
   throw std::logic_error("shall not reach here");
 }
 
 auto SecretStorageAccessor::remove_secret(std::string_view key, bool allow_missing) -> bool {
-  output_message->type  = Message::Type::Delete;
-  output_message->flags = allow_missing ? Message::Flags::Delete_AllowMissing : 0;
-  auto *const body      = reinterpret_cast<SingleEntryBody *>(output_message->data);
-  body->length          = key.size();
+  output_message()->type  = Message::Type::Delete;
+  output_message()->flags = allow_missing ? Message::Flags::Delete_AllowMissing : 0;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = key.size();
   memcpy(body->data, key.data(), key.size());
-  int socket_fd = send_message(output_message, sizeof(Message) + sizeof(SingleEntryBody) + body->length);
-  if (socket_fd == -1) {
+  if (!request(sizeof(Message) + sizeof(SingleEntryBody) + body->length)) {
     return false;
   }
-  recv(socket_fd, input_message, sizeof(Message), MSG_WAITALL);
-  close(socket_fd);
-  if (input_message->type == Message::Type::Ok) {
+  if (input_message()->type == Message::Type::Ok) {
     return true;
-  } else if (input_message->type == Message::Type::Failed) {
+  } else if (input_message()->type == Message::Type::Failed) {
     return false;
   }
   throw std::logic_error("shall not reach here");
 }
 
 void SecretStorageAccessor::terminate_server() {
-  output_message->type  = Message::Type::Terminate;
-  output_message->flags = 0;
-  close(send_message(output_message, sizeof(Message)));
+  output_message()->type  = Message::Type::Terminate;
+  output_message()->flags = 0;
+  close(send_message(output_message(), sizeof(Message)));
 }
 
-auto SecretStorageAccessor::get_secret(std::string_view key, SecretStorageAccessor::GetOption option)
-  -> std::string_view {
-  output_message->type  = Message::Type::Query;
-  output_message->flags = option.remove_ ? Message::Flags::Query_DeleteSecret : 0;
-  auto *const body      = reinterpret_cast<SingleEntryBody *>(output_message->data);
-  body->length          = key.size();
-  memcpy(body->data, key.data(), key.size());
-  int socket_fd = send_message(output_message, sizeof(Message) + sizeof(SingleEntryBody) + body->length);
-  if (socket_fd != -1) {
-    recv(socket_fd, input_message, sizeof(Message), MSG_WAITALL);
-    if (input_message->type == Message::Type::Result) {
-      auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message->data);
-      input_body->receive(socket_fd);
+auto SecretStorageAccessor::stats() -> std::string {
+  output_message()->type  = Message::Type::Stats;
+  output_message()->flags = 0;
+  if (!request(sizeof(Message)) || input_message()->type != Message::Type::Result) {
+    return {};
+  }
+  auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message()->data);
+  return {reinterpret_cast<char *>(input_body->data), input_body->length};
+}
+
+auto SecretStorageAccessor::list_prefix(std::string_view prefix) -> std::vector<std::string_view> {
+  output_message()->type  = Message::Type::ListPrefix;
+  output_message()->flags = 0;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = prefix.size();
+  memcpy(body->data, prefix.data(), prefix.size());
+  std::vector<std::string_view> result;
+  int socket_fd = send_message(output_message(), sizeof(Message) + sizeof(SingleEntryBody) + body->length);
+  if (socket_fd == -1) {
+    return result;
+  }
+  // keys are packed as many to a send as fit, so most of them are taken without a recv of their own
+  MessageReceiver receiver(socket_fd, input_message());
+  while (receiver.receive()) {
+    if (input_message()->type != Message::Type::Result) {
+      break;
+    }
+    auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message()->data);
+    result.push_back(
+      view_wrapper(secured_string(reinterpret_cast<char *>(input_body->data), input_body->length))
+    );
+  }
+  close(socket_fd);
+  return result;
+}
+
+auto SecretStorageAccessor::remove_prefix(std::string_view prefix) -> std::optional<size_t> {
+  output_message()->type  = Message::Type::DeletePrefix;
+  output_message()->flags = 0;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = prefix.size();
+  memcpy(body->data, prefix.data(), prefix.size());
+  int socket_fd = send_message(output_message(), sizeof(Message) + sizeof(SingleEntryBody) + body->length);
+  if (socket_fd == -1) {
+    return {};
+  }
+  MessageReceiver receiver(socket_fd, input_message());
+  if (!receiver.receive() || input_message()->type != Message::Type::Result) {
+    close(socket_fd);
+    return {};
+  }
+  close(socket_fd);
+  auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message()->data);
+  uint64_t result;
+  if (input_body->length != sizeof(result)) {
+    return {};
+  }
+  memcpy(&result, input_body->data, sizeof(result));
+  return result;
+}
+
+auto SecretStorageAccessor::watch(
+  std::span<const std::string_view> keys, std::span<const std::string_view> prefixes
+) -> int {
+  constexpr size_t limit = MessageBufferSize - sizeof(Message) - sizeof(SingleEntryBody);
+  const auto       count = keys.size() + prefixes.size();
+  const auto       fits  = [](std::string_view key) { return key.size() <= limit; };
+  if (count == 0 || !std::ranges::all_of(keys, fits) || !std::ranges::all_of(prefixes, fits)) {
+    return -1;
+  }
+  // replies are no more than a few bytes each, so all requests are sent before any reply is read
+  secured_buffer buffer;
+  const auto     append = [&](std::span<const std::string_view> patterns, uint8_t flags) {
+    for (const auto &pattern : patterns) {
+      auto *const body = append_message<SingleEntryBody>(buffer, Message::Type::Watch, flags, pattern.size());
+      body->length     = pattern.size();
+      memcpy(body->data, pattern.data(), pattern.size());
+    }
+  };
+  append(keys, 0);
+  append(prefixes, Message::Flags::Watch_Prefix);
+  int socket_fd = start_batch(count);
+  if (socket_fd == -1) {
+    return -1;
+  }
+  if (!send_all(socket_fd, buffer.data(), buffer.size())) {
+    close(socket_fd);
+    return -1;
+  }
+  // taken one at a time, as events may follow right behind the last reply
+  for (size_t i = 0; i < count; i++) {
+    if (!receive_message(socket_fd, input_message()) || input_message()->type != Message::Type::Ok) {
       close(socket_fd);
-      return view_wrapper(secured_string(reinterpret_cast<char *>(input_body->data), input_body->length));
+      return -1;
     }
+  }
+  return socket_fd;
+}
+
+auto SecretStorageAccessor::next_event(int watch) -> std::optional<std::pair<Event, std::string>> {
+  // received into a buffer of its own instead of the shared one, as waiting for an event may take long, e.g.
+  //  with the GIL released by the python module, while other threads keep making requests
+  const MessageBuffers buffers(1);
+  auto *const          input = reinterpret_cast<Message *>(buffers.data);
+  if (!receive_message(watch, input) || input->type != Message::Type::Event) {
+    return {};
+  }
+  auto *const input_body = reinterpret_cast<SingleEntryBody *>(input->data);
+  auto event = Event::Added;
+  if (input->flags & Message::Flags::Event_Replaced) {
+    event = Event::Replaced;
+  } else if (input->flags & Message::Flags::Event_Deleted) {
+    event = Event::Deleted;
+  } else if (input->flags & Message::Flags::Event_Expired) {
+    event = Event::Expired;
+  } else if (input->flags & Message::Flags::Event_Evicted) {
+    event = Event::Evicted;
+  }
+  return std::make_pair(event, std::string(reinterpret_cast<char *>(input_body->data), input_body->length));
+}
+
+void SecretStorageAccessor::unwatch(int watch) { close(watch); }
+
+auto SecretStorageAccessor::attach() -> bool {
+  if (channel != nullptr) {
+    return true;
+  }
+  output_message()->type  = Message::Type::Attach;
+  output_message()->flags = 0;
+  int socket_fd           = send_message(output_message(), sizeof(Message));
+  if (socket_fd == -1) {
+    return false;
+  }
+  // the memfd of the channel comes as ancillary data of the reply
+  iovec  iov{input_message(), sizeof(Message)};
+  msghdr header{};
+  alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))]{};
+  header.msg_iov        = &iov;
+  header.msg_iovlen     = 1;
+  header.msg_control    = control;
+  header.msg_controllen = sizeof(control);
+  int        memfd      = -1;
+  const auto received   = recvmsg(socket_fd, &header, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  auto *const rights    = CMSG_FIRSTHDR(&header);
+  if (rights != nullptr && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS
+      && rights->cmsg_len == CMSG_LEN(sizeof(memfd))) {
+    memcpy(&memfd, CMSG_DATA(rights), sizeof(memfd));
+  }
+  if (received == sizeof(Message) && input_message()->type == Message::Type::Ok && memfd != -1) {
+    channel = Channel::map(memfd);
+  }
+  if (memfd != -1) {
+    close(memfd);
+  }
+  if (channel == nullptr) {
     close(socket_fd);
+    return false;
+  }
+  channel_socket = socket_fd;
+  return true;
+}
+
+void SecretStorageAccessor::detach() {
+  if (channel == nullptr) {
+    return;
+  }
+  // the server stops serving the channel once it sees the connection closed
+  Channel::unmap(channel);
+  close(channel_socket);
+  channel        = nullptr;
+  channel_socket = -1;
+}
+
+auto SecretStorageAccessor::submit_secrets(
+  std::span<const std::pair<std::string_view, std::string_view>> secrets, bool replace, bool evictable
+) -> size_t {
+  constexpr size_t limit = MessageBufferSize - sizeof(Message) - sizeof(DoubleEntryBody);
+  // secrets that do not fit into a message are never sent and counted as rejected
+  uint32_t count = 0;
+  for (const auto &[key, value] : secrets) {
+    count += key.size() + value.size() <= limit;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  int socket_fd = start_batch(count);
+  if (socket_fd == -1) {
+    return 0;
+  }
+  MessageReceiver receiver(socket_fd, input_message());
+  size_t          accepted = 0;
+  secured_buffer  buffer;
+  auto            iterator = secrets.begin();
+  while (iterator != secrets.end()) {
+    buffer.clear();
+    size_t round = 0;
+    for (; iterator != secrets.end() && round < batch_round; iterator++) {
+      const auto &[key, value] = *iterator;
+      if (key.size() + value.size() > limit) {
+        continue;
+      }
+      auto *const body = append_message<DoubleEntryBody>(
+        buffer, Message::Type::Add, add_flags(replace, evictable), key.size() + value.size()
+      );
+      body->length[0] = key.size();
+      body->length[1] = value.size();
+      memcpy(body->data, key.data(), key.size());
+      memcpy(body->data + key.size(), value.data(), value.size());
+      round++;
+    }
+    if (!send_all(socket_fd, buffer.data(), buffer.size())) {
+      break;
+    }
+    for (size_t i = 0; i < round; i++) {
+      if (!receiver.receive()) {
+        close(socket_fd);
+        return accepted;
+      }
+      accepted += input_message()->type == Message::Type::Ok;
+    }
+  }
+  close(socket_fd);
+  return accepted;
+}
+
+auto SecretStorageAccessor::get_secrets(std::span<const std::string_view> keys)
+  -> std::vector<std::string_view> {
+  constexpr size_t              limit = MessageBufferSize - sizeof(Message) - sizeof(SingleEntryBody);
+  std::vector<std::string_view> result(keys.size());
+  uint32_t                      count = 0;
+  for (const auto &key : keys) {
+    count += key.size() <= limit;
+  }
+  if (count == 0) {
+    return result;
+  }
+  int socket_fd = start_batch(count);
+  if (socket_fd == -1) {
+    return result;
+  }
+  MessageReceiver receiver(socket_fd, input_message());
+  secured_buffer  buffer;
+  size_t          index = 0;
+  while (index < keys.size()) {
+    buffer.clear();
+    std::vector<size_t> round;
+    for (; index < keys.size() && round.size() < batch_round; index++) {
+      if (keys[index].size() > limit) {
+        continue;
+      }
+      auto *const body = append_message<SingleEntryBody>(buffer, Message::Type::Query, 0, keys[index].size());
+      body->length     = keys[index].size();
+      memcpy(body->data, keys[index].data(), keys[index].size());
+      round.push_back(index);
+    }
+    if (!send_all(socket_fd, buffer.data(), buffer.size())) {
+      break;
+    }
+    for (auto position : round) {
+      if (!receiver.receive()) {
+        close(socket_fd);
+        return result;
+      }
+      if (input_message()->type == Message::Type::Result) {
+        auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message()->data);
+        result[position] =
+          view_wrapper(secured_string(reinterpret_cast<char *>(input_body->data), input_body->length));
+      }
+    }
+  }
+  close(socket_fd);
+  return result;
+}
+
+auto SecretStorageAccessor::get_secret(std::string_view key, SecretStorageAccessor::GetOption option)
+  -> std::string_view {
+  output_message()->type  = Message::Type::Query;
+  output_message()->flags = option.remove_ ? Message::Flags::Query_DeleteSecret : 0;
+  auto *const body        = reinterpret_cast<SingleEntryBody *>(output_message()->data);
+  body->length            = key.size();
+  memcpy(body->data, key.data(), key.size());
+  if (request(sizeof(Message) + sizeof(SingleEntryBody) + body->length)
+      && input_message()->type == Message::Type::Result) {
+    auto *const input_body = reinterpret_cast<SingleEntryBody *>(input_message()->data);
+    return view_wrapper(secured_string(reinterpret_cast<char *>(input_body->data), input_body->length));
   }
   if (!option.ask()) {
     return {};
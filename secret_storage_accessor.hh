@@ -1,7 +1,13 @@
 #ifndef SECRET_STORAGE_ACCESSOR_HH_
 #define SECRET_STORAGE_ACCESSOR_HH_
 #include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 namespace SecretStorageAccessor {
 // ---- begin of local utilities that does not depends on a running server ----
 
@@ -14,17 +20,37 @@ void release_secured_string(std::string_view string);
 // make a randomly generated key that is stored in locked memory page
 //  note that the key is generated in binary from that will not be a valid string under any encoding
 //  it should be fine to use keys not stored in locked memory areas if they are generated randomly
+//  keys are drawn from a generator in locked memory seeded by the kernel, so no syscall is made per key
 auto make_secured_key(size_t length) -> std::string_view;
 
-// hex (base16) encode a string
+// make a number of randomly generated keys of the same length at once, each of which shall be released
+auto make_secured_keys(size_t count, size_t length) -> std::vector<std::string_view>;
+
+// hex (base16) encode a string in upper case
 auto encode_string(std::string_view string) -> std::string_view;
 
-// hex (base16) decode a string
+// hex (base16) decode a string, digits of either case are accepted
+//  an empty string is returned if the string is not a valid base16 encoding
 //  note that in no case shall a string in locked memory being decoded, therefore this function returns
 //   only a normal string that is not stored in locked memory area and shall not be freed
 //   that is, you have the ownership of it
 auto decode_string(std::string_view string) -> std::string;
 
+// hex (base16) decode a string into locked memory
+//  this is intended for secret values that arrive encoded, e.g. from an exported file
+//  an empty view is returned if the string is not a valid base16 encoding
+auto decode_secured_string(std::string_view string) -> std::string_view;
+
+// base64 encode a string with the standard alphabet and padding
+auto encode_base64(std::string_view string) -> std::string_view;
+
+// base64 decode a string into ordinary memory, which you have the ownership of, like decode_string
+//  an empty string is returned if the string is not a valid padded base64 encoding
+auto decode_base64(std::string_view string) -> std::string;
+
+// base64 decode a string into locked memory, like decode_secured_string
+auto decode_secured_base64(std::string_view string) -> std::string_view;
+
 // ask user to enter a secret via stdin/stdout
 //  the result is not attached with a key and is not stored to be returned for further ask_secret calls
 //  calling to this function is always interactive that requires the user to input something
@@ -37,21 +63,76 @@ auto ask_secret(const char *prompt, const char *retry_prompt = nullptr) -> std::
 //  note that this function will be called automatically with nullptr if before connecting to the server if an
 //   address is not previously specified, so you can simply do nothing to use the default path
 //  this function can be called at any point to change the socket path
+//  sockets of further reactors of the server, path.1, path.2 and so on, are looked up here, and requests on
+//   a key are sent to the one owning the key
 //  return true if the socket path is valid, false otherwise
 auto set_socket_path(const char *socket_path = nullptr) -> bool;
 
 // low-level server accessors
+//  a request the server is too busy to take is retried a few times after the delay it hints at, plus a
+//   jittered backoff, except for the batched ones which fail as a whole
 
 // check if a server is up and running
 auto ping() -> bool;
 // check if a secret is registered on the server
 auto exists(std::string_view key) -> bool;
 // set a secret directly to server
-auto submit_secret(std::string_view key, std::string_view value, bool replace = false) -> bool;
+//  an evictable secret may be evicted by the server to make room for others once it runs short of its quotas
+//   or locked memory, while any other one is kept until deleted
+//  fails if the secret does not fit even after evicting what the server could
+auto submit_secret(std::string_view key, std::string_view value, bool replace = false, bool evictable = false)
+  -> bool;
 // delete a secret on server
 auto remove_secret(std::string_view key, bool allow_missing = false) -> bool;
 // terminate the server
 void terminate_server();
+// query statistics of the server as human readable text, empty if failed to communicate with the server
+auto stats() -> std::string;
+
+// keys can be organized in hierarchical namespaces by sharing a prefix, e.g. "tenant/service/key"
+// list keys on server that start with prefix, values are never transferred
+//  each key returned is a secured string that shall be released
+auto list_prefix(std::string_view prefix) -> std::vector<std::string_view>;
+// delete all secrets on server whose key starts with prefix
+//  return the number of secrets deleted, or nothing if failed to communicate with the server
+auto remove_prefix(std::string_view prefix) -> std::optional<size_t>;
+
+// keys can be watched for changes instead of being polled
+//  changes are pushed over a connection kept open, which can be waited on with poll or epoll as well
+enum class Event : uint8_t {
+  Added,    // a secret was added
+  Replaced, // the value of a secret was replaced
+  Deleted,  // a secret was deleted
+  Expired,  // a secret was consumed by a query removing it
+  Evicted,  // an evictable secret was evicted to make room for another one
+};
+// open a connection watching keys, and all keys starting with any of prefixes
+//  return the descriptor of the connection, or -1 if failed or any key or prefix was refused
+auto watch(std::span<const std::string_view> keys, std::span<const std::string_view> prefixes = {}) -> int;
+// wait for the next change pushed over a connection opened by watch, nothing is returned once it is closed
+//  it shares no buffer with other requests, so a thread may wait in it while others make requests
+//  values are never pushed, and keys are returned in ordinary memory that you have the ownership of
+auto next_event(int watch) -> std::optional<std::pair<Event, std::string>>;
+// stop watching and close the connection
+void unwatch(int watch);
+
+// ping, stats and requests on a single key can go over a channel in shared memory instead of a connection of
+//  their own each, which saves connecting and every send and receive as long as the server keeps up
+// attach a channel, over which those requests go from now on, return false if the server refused one
+auto attach() -> bool;
+// detach the channel attached, after which every request goes over a connection of its own again
+void detach();
+
+// bulk accessors, all requests are sent over a single connection in batches
+// set a number of secrets directly to server, return the number of secrets accepted
+auto submit_secrets(
+  std::span<const std::pair<std::string_view, std::string_view>> secrets,
+  bool                                                           replace   = false,
+  bool                                                           evictable = false
+) -> size_t;
+// get a number of secrets from server, the result holds one entry per key in the same order
+//  a missing secret is represented by an empty view, any other entry shall be released
+auto get_secrets(std::span<const std::string_view> keys) -> std::vector<std::string_view>;
 
 // high-level APIs
 struct GetOption {
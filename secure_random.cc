@@ -0,0 +1,132 @@
+#include "secure_random.hh"
+#include "hardened_memory_allocator.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sys/random.h>
+
+SecureRandom::State *SecureRandom::state  = nullptr;
+bool                 SecureRandom::forked = false;
+
+static inline auto rotate(uint32_t value, int bits) -> uint32_t {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+static inline void quarter_round(uint32_t *x, int a, int b, int c, int d) {
+  x[a] += x[b];
+  x[d]  = rotate(x[d] ^ x[a], 16);
+  x[c] += x[d];
+  x[b]  = rotate(x[b] ^ x[c], 12);
+  x[a] += x[b];
+  x[d]  = rotate(x[d] ^ x[a], 8);
+  x[c] += x[d];
+  x[b]  = rotate(x[b] ^ x[c], 7);
+}
+
+// a single ChaCha20 block as of RFC 8439, with an all zero nonce as every key is used for one batch only
+void SecureRandom::block(const uint32_t *key, uint32_t counter, uint8_t *output) {
+  uint32_t input[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+  memcpy(input + 4, key, KeySize);
+  input[12] = counter;
+  uint32_t x[16];
+  memcpy(x, input, sizeof(x));
+  for (int i = 0; i < 10; i++) {
+    quarter_round(x, 0, 4, 8, 12);
+    quarter_round(x, 1, 5, 9, 13);
+    quarter_round(x, 2, 6, 10, 14);
+    quarter_round(x, 3, 7, 11, 15);
+    quarter_round(x, 0, 5, 10, 15);
+    quarter_round(x, 1, 6, 11, 12);
+    quarter_round(x, 2, 7, 8, 13);
+    quarter_round(x, 3, 4, 9, 14);
+  }
+  for (int i = 0; i < 16; i++) {
+    x[i] += input[i];
+  }
+  // the keystream is serialized little endian, which is the native order on every platform supported
+  memcpy(output, x, BlockSize);
+  explicit_bzero(x, sizeof(x));
+  explicit_bzero(input, sizeof(input));
+}
+
+void SecureRandom::initialize() {
+  state = reinterpret_cast<State *>(HardenedMemoryManager::allocate(sizeof(State)));
+  memset(state, 0, sizeof(State));
+  // a child must never produce the same bytes as its parent
+  pthread_atfork(nullptr, nullptr, []() { forked = true; });
+  reseed();
+}
+
+void SecureRandom::reseed() {
+  // drawn into the batch, which is discarded anyway, so that entropy never leaves locked memory
+  auto *const entropy = state->batch;
+  size_t      filled  = 0;
+  while (filled < KeySize) {
+    const auto result = getrandom(entropy + filled, KeySize - filled, 0);
+    if (result > 0) {
+      filled += result;
+    } else if (result == -1 && errno != EINTR) {
+      // nothing handed out may ever be predictable, so a generator that cannot be seeded does not go on
+      abort();
+    }
+  }
+  // mixed into the current key, so a weak reseed never makes the generator worse than it already is
+  auto *const key = reinterpret_cast<uint8_t *>(state->key);
+  for (size_t i = 0; i < KeySize; i++) {
+    key[i] ^= entropy[i];
+  }
+  explicit_bzero(state->batch, sizeof(state->batch));
+  state->counter   = 0;
+  state->available = 0;
+  state->generated = 0;
+  forked           = false;
+}
+
+void SecureRandom::generate(uint8_t *output, size_t length) {
+  for (size_t i = 0; i < length; i += BlockSize) {
+    block(state->key, state->counter++, output + i);
+  }
+  state->generated += length;
+}
+
+void SecureRandom::refill() {
+  generate(state->batch, BatchSize);
+  memcpy(state->key, state->batch, KeySize);
+  explicit_bzero(state->batch, KeySize);
+  state->counter   = 0;
+  state->available = BatchSize - KeySize;
+}
+
+void SecureRandom::fill(void *buffer, size_t length) {
+  if (state == nullptr) {
+    initialize();
+  }
+  auto *output = reinterpret_cast<uint8_t *>(buffer);
+  while (length != 0) {
+    if (forked || state->generated >= ReseedSize) {
+      reseed();
+    }
+    if (state->available == 0 && length >= BatchSize) {
+      // large requests are generated in place, then the key is rotated by the refill below
+      const auto size = std::min(length / BlockSize * BlockSize, ReseedSize);
+      generate(output, size);
+      output += size;
+      length -= size;
+      refill();
+      continue;
+    }
+    if (state->available == 0) {
+      refill();
+    }
+    // bytes are consumed from the end of the batch and wiped as soon as they are handed out
+    const auto size  = std::min(length, state->available);
+    auto *const from = state->batch + KeySize + state->available - size;
+    memcpy(output, from, size);
+    explicit_bzero(from, size);
+    state->available -= size;
+    output           += size;
+    length           -= size;
+  }
+}
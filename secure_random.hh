@@ -0,0 +1,42 @@
+#ifndef SECURE_RANDOM_HH_
+#define SECURE_RANDOM_HH_
+#include <cstddef>
+#include <cstdint>
+
+// cryptographically secure generator for keys and nonces without a syscall on every call
+//  a ChaCha20 keystream is generated in batches, its first 32 bytes rekeying the generator right away so
+//   that bytes already handed out cannot be recovered from the state afterwards
+//  the state lives in locked memory and is reseeded from getrandom periodically and in a forked child
+//  like the rest of the accessor, it is not meant to be used from several threads at once
+class SecureRandom {
+public:
+  SecureRandom() = delete;
+  static void fill(void *buffer, size_t length);
+
+private:
+  static constexpr size_t KeySize    = 32;
+  static constexpr size_t BlockSize  = 64;
+  static constexpr size_t BatchSize  = 16 * BlockSize;
+  // bytes generated before the key is mixed with fresh entropy again
+  static constexpr size_t ReseedSize = size_t(1) << 24;
+
+  struct State {
+    uint32_t key[KeySize / sizeof(uint32_t)];
+    uint32_t counter;
+    size_t   available;
+    size_t   generated;
+    uint8_t  batch[BatchSize];
+  };
+
+  static State *state;
+  static bool   forked;
+
+  static void initialize();
+  static void reseed();
+  static void block(const uint32_t *key, uint32_t counter, uint8_t *output);
+  // generate blocks of keystream into output, which is a multiple of BlockSize
+  static void generate(uint8_t *output, size_t length);
+  // refill the batch, rekeying with its first bytes
+  static void refill();
+};
+#endif
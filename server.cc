@@ -1,9 +1,24 @@
 #include "server.hh"
+#include "channel.hh"
 #include "message.hh"
+#include "numa.hh"
+#include "trace.hh"
+#include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <iterator>
+#include <new>
+#include <poll.h>
 #include <print>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -14,113 +29,387 @@ auto Server::build(Storage &storage) -> Server & {
   return instance;
 }
 
-Server::Server(Storage &storage) : storage(storage) {}
+// the number of listening sockets passed by a service manager as with sd_listen_fds, from descriptor 3 on
+//  each of them must be a unix stream socket already listening, those following one that is not are unused
+static auto inherited_sockets() -> size_t {
+  static constexpr int first = 3;
+
+  const char *pid   = getenv("LISTEN_PID");
+  const char *count = getenv("LISTEN_FDS");
+  if (pid == nullptr || count == nullptr || std::strtol(pid, nullptr, 10) != getpid()
+      || std::strtol(count, nullptr, 10) < 1) {
+    return 0;
+  }
+  const auto passed = static_cast<size_t>(std::strtol(count, nullptr, 10));
+  // children started later shall not take the sockets for theirs
+  unsetenv("LISTEN_PID");
+  unsetenv("LISTEN_FDS");
+  unsetenv("LISTEN_FDNAMES");
+  size_t result = 0;
+  for (; result < passed; result++) {
+    const int   socket_fd = first + static_cast<int>(result);
+    int         type      = 0;
+    int         listening = 0;
+    sockaddr_un address{};
+    socklen_t   length = sizeof(type);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_TYPE, &type, &length) == -1 || type != SOCK_STREAM) {
+      break;
+    }
+    length = sizeof(listening);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) == -1 || listening == 0) {
+      break;
+    }
+    length = sizeof(address);
+    if (getsockname(socket_fd, reinterpret_cast<sockaddr *>(&address), &length) == -1
+        || address.sun_family != AF_UNIX) {
+      break;
+    }
+    fcntl(socket_fd, F_SETFD, FD_CLOEXEC);
+  }
+  return result;
+}
+
+Server::Server(Storage &storage) : storage(storage) {
+  storage.set_journal([this](std::string_view key, std::optional<std::string_view> value, bool evictable) {
+    this->replicate(key, value, evictable);
+  });
+}
 Server::~Server() {
-  close(this->socket_fd);
-  std::filesystem::remove(this->address);
+  for (auto &reactor : this->reactors) {
+    while (!reactor.watching.empty()) {
+      this->unwatch(reactor, reactor.watching.front());
+    }
+    close(reactor.socket_fd);
+    close(reactor.wakeup_fd);
+    if (!reactor.inherited && !reactor.address.empty()) {
+      std::filesystem::remove(reactor.address);
+    }
+  }
+  if (this->metrics_fd != -1) {
+    // wakes up the metrics thread blocking in accept
+    shutdown(this->metrics_fd, SHUT_RDWR);
+    if (this->metrics_thread.joinable()) {
+      this->metrics_thread.join();
+    }
+    close(this->metrics_fd);
+    std::filesystem::remove(this->metrics_address);
+  }
 }
 
 auto Server::start(const char *address) -> bool {
+  const auto                 inherited = inherited_sockets();
+  std::optional<sockaddr_un> base;
+  if (inherited > 0) {
+    // sockets of further reactors not passed are created next to the first one passed
+    sockaddr_un name{};
+    socklen_t   length = sizeof(name);
+    getsockname(3, reinterpret_cast<sockaddr *>(&name), &length);
+    base = name;
+  } else {
+    base = make_address(address, true);
+  }
+  if (!base.has_value()) {
+    return false;
+  }
+  // reactors never move once started, as their threads refer to them
+  this->reactors = std::vector<Reactor>(this->reactor_count);
+  for (size_t i = 0; i < this->reactors.size(); i++) {
+    auto &reactor = this->reactors[i];
+    reactor.index = i;
+    if (i < inherited) {
+      // the socket outlives this process, so clients keep queuing on it while the server restarts
+      reactor.socket_fd = 3 + static_cast<int>(i);
+      reactor.inherited = true;
+    } else {
+      const auto reactor_address = ::reactor_address(base.value(), i);
+      if (!reactor_address.has_value() || !this->listen_on(reactor, reactor_address.value())) {
+        return false;
+      }
+    }
+    // connections are accepted until the backlog is empty whenever it becomes readable
+    fcntl(reactor.socket_fd, F_SETFL, fcntl(reactor.socket_fd, F_GETFL) | O_NONBLOCK);
+    reactor.wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (reactor.wakeup_fd == -1) {
+      return false;
+    }
+  }
+  struct sigaction action;
+  action.sa_handler = dummy_handler;
+  action.sa_flags   = 0;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  return true;
+}
+
+auto Server::listen_on(Reactor &reactor, const sockaddr_un &address) -> bool {
+  reactor.socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (reactor.socket_fd == -1) {
+    return false;
+  }
+  int return_value =
+    bind(reactor.socket_fd, reinterpret_cast<const struct sockaddr *>(&address), sizeof(address));
+  if (return_value == -1) {
+    return false;
+  }
+  reactor.address = address.sun_path;
+  return listen(reactor.socket_fd, this->backlog) != -1;
+}
+
+auto Server::start_metrics(const char *address) -> bool {
   auto result = make_address(address, true);
   if (!result.has_value()) {
     return false;
   }
   sockaddr_un unix_socket_address = result.value();
-  this->socket_fd                 = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (this->socket_fd == -1) {
+  this->metrics_fd                = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (this->metrics_fd == -1) {
     return false;
   }
   int return_value = bind(
-    this->socket_fd,
+    this->metrics_fd,
     reinterpret_cast<const struct sockaddr *>(&unix_socket_address),
     sizeof(unix_socket_address)
   );
   if (return_value == -1) {
     return false;
   }
-  this->address = unix_socket_address.sun_path;
-  return_value  = listen(this->socket_fd, 5);
-  if (return_value == -1) {
-    return false;
+  this->metrics_address = unix_socket_address.sun_path;
+  return listen(this->metrics_fd, 5) != -1;
+}
+
+void Server::enforce(Policy &&policy) { this->policy = std::move(policy); }
+
+auto Server::start_capture(const char *path) -> bool {
+  this->capture = Capture::open(path);
+  return this->capture != nullptr;
+}
+
+void Server::set_deadlines(std::chrono::milliseconds io_timeout, std::chrono::milliseconds grace_period) {
+  this->io_timeout   = io_timeout;
+  this->grace_period = grace_period;
+}
+
+void Server::set_limits(int backlog, size_t max_queued, size_t max_per_peer) {
+  this->backlog      = backlog;
+  this->max_queued   = max_queued;
+  this->max_per_peer = max_per_peer;
+}
+
+void Server::set_reactors(size_t count) { this->reactor_count = std::max<size_t>(count, 1); }
+
+void Server::set_reserve(size_t bytes) { this->reserve_locked = bytes; }
+
+void Server::stop() {
+  this->running = false;
+  for (const auto &reactor : this->reactors) {
+    const uint64_t wakeup = 1;
+    write(reactor.wakeup_fd, &wakeup, sizeof(wakeup));
   }
-  struct sigaction action;
-  action.sa_handler = dummy_handler;
-  action.sa_flags   = 0;
-  sigemptyset(&action.sa_mask);
-  sigaction(SIGINT, &action, nullptr);
-  return true;
 }
 
-void Server::serve() {
-  constexpr size_t                 buffer_size = 2000;
-  HardenedMemoryAllocator<uint8_t> allocator;
-  auto *const input_message  = reinterpret_cast<Message *>(allocator.allocate(buffer_size));
-  auto *const output_message = reinterpret_cast<Message *>(allocator.allocate(buffer_size));
-  while (this->running) {
-    int pair_socket = accept(this->socket_fd, nullptr, nullptr);
+auto Server::authorize(const std::optional<ucred> &credentials) const -> Policy::Access {
+  if (!this->policy.has_value()) {
+    return Policy::Access::unrestricted();
+  }
+  if (!credentials.has_value()) {
+    // nothing is granted to a peer that cannot be identified
+    return {};
+  }
+  return this->policy->compile(credentials.value());
+}
+
+// reply a Failed message describing why the request failed, return the length of the reply
+static auto fail(Message *output_message, std::string_view reason) -> size_t {
+  output_message->type  = Message::Type::Failed;
+  output_message->flags = Message::Flags::Failed_DescriptionAttached;
+  auto *const output    = reinterpret_cast<SingleEntryBody *>(output_message->data);
+  output->length        = reason.size();
+  memcpy(output->data, reason.data(), reason.size());
+  return sizeof(Message) + sizeof(SingleEntryBody) + reason.size();
+}
+
+// reply a Failed message telling that the request was denied by the policy, return the length of the reply
+static auto deny(Message *output_message) -> size_t { return fail(output_message, "permission denied"); }
+
+void Server::notify(uint8_t event, std::string_view key) {
+  // a key that does not fit into an event, as one loaded on startup may not, is not pushed
+  if (this->watcher_count.load(std::memory_order_relaxed) == 0
+      || key.size() > MessageBufferSize - sizeof(Message) - sizeof(SingleEntryBody)) {
+    return;
+  }
+  uint8_t     buffer[MessageBufferSize];
+  auto *const message = reinterpret_cast<Message *>(buffer);
+  message->type       = Message::Type::Event;
+  message->flags      = event;
+  auto *const body    = reinterpret_cast<SingleEntryBody *>(message->data);
+  body->length        = key.size();
+  memcpy(body->data, key.data(), key.size());
+  const auto length = sizeof(Message) + sizeof(SingleEntryBody) + key.size();
+
+  // a connection watching key in several ways is notified once
+  std::lock_guard<std::mutex> lock(this->watchers_mutex);
+  int                         notified = -1;
+  for (const auto &watcher : this->watchers) {
+    const std::string_view pattern(watcher.pattern.data(), watcher.pattern.size());
+    if (watcher.socket == notified || !(watcher.prefix ? key.starts_with(pattern) : key == pattern)) {
+      continue;
+    }
+    notified = watcher.socket;
+    // a watcher that does not keep up is dropped rather than allowed to stall the server, which is left to
+    //  the reactor it belongs to, as that may be another one polling it right now
+    if (send(watcher.socket, buffer, length, MSG_NOSIGNAL | MSG_DONTWAIT) != static_cast<ssize_t>(length)) {
+      shutdown(watcher.socket, SHUT_RDWR);
+    }
+  }
+}
+
+void Server::unwatch(Reactor &reactor, int socket) {
+  {
+    std::lock_guard<std::mutex> lock(this->watchers_mutex);
+    std::erase_if(this->watchers, [socket](const Watcher &watcher) { return watcher.socket == socket; });
+    this->watcher_count.store(this->watchers.size(), std::memory_order_relaxed);
+  }
+  std::erase(reactor.watching, socket);
+  close(socket);
+}
+
+void Server::serve_metrics() {
+  while (true) {
+    int pair_socket = accept(this->metrics_fd, nullptr, nullptr);
     if (pair_socket == -1) {
-      if (errno == EINTR) {
-        break;
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
       }
-      continue;
+      break;
     }
-    recv(pair_socket, input_message, sizeof(Message), MSG_WAITALL);
-    size_t result_length = sizeof(Message);
+    // the request is not parsed, every request is answered with all metrics
+    //  it is still consumed if it arrives in time, so that the peer does not see a reset connection
+    constexpr timeval timeout{.tv_sec = 1, .tv_usec = 0};
+    char              request[1024];
+    setsockopt(pair_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    recv(pair_socket, request, sizeof(request), 0);
+    const auto body     = this->metrics.prometheus(this->storage.size());
+    const auto response = std::format(
+      "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {}\r\n\r\n{}",
+      body.size(),
+      body
+    );
+    send(pair_socket, response.data(), response.size(), MSG_NOSIGNAL);
+    close(pair_socket);
+  }
+}
 
-    if (input_message->type == Message::Type::Ping) { // handle Ping requests
-      output_message->type = Message::Type::Pong;
-      auto *const input    = reinterpret_cast<SingleEntryBody *>(input_message->data);
-      auto *const output   = reinterpret_cast<SingleEntryBody *>(output_message->data);
-      input->receive(pair_socket);
-      output->length = input->length;
-      memcpy(output->data, input->data, input->length);
-      result_length += sizeof(SingleEntryBody) + output->length;
-    } else if (input_message->type == Message::Type::Add) { // handle Add requests
-      auto *const input = reinterpret_cast<DoubleEntryBody *>(input_message->data);
-      input->receive(pair_socket);
-      bool result = true;
-      if (input_message->flags & Message::Flags::Add_ReplaceExisting) {
-        this->storage.update(
-          secured_string(reinterpret_cast<const char *>(input->data), input->length[0]),
-          secured_string(reinterpret_cast<const char *>(input->data + input->length[0]), input->length[1])
+// requests replied by a single message, which are taken over channels as well
+static auto self_contained(uint8_t type) -> bool {
+  return type == Message::Type::Ping || type == Message::Type::Add || type == Message::Type::Query
+         || type == Message::Type::Delete || type == Message::Type::Stats;
+}
+
+// whether a request of length taken over a channel is self contained and holds all of its body
+static auto well_formed(const Message *input_message, size_t length) -> bool {
+  if (length < sizeof(Message) || !self_contained(input_message->type)) {
+    return false;
+  }
+  if (input_message->type == Message::Type::Stats) {
+    return true;
+  }
+  if (input_message->type == Message::Type::Add) {
+    const auto *const body = reinterpret_cast<const DoubleEntryBody *>(input_message->data);
+    return length >= sizeof(Message) + sizeof(DoubleEntryBody)
+           && length >= sizeof(Message) + sizeof(DoubleEntryBody) + body->length[0] + body->length[1];
+  }
+  const auto *const body = reinterpret_cast<const SingleEntryBody *>(input_message->data);
+  return length >= sizeof(Message) + sizeof(SingleEntryBody)
+         && length >= sizeof(Message) + sizeof(SingleEntryBody) + body->length;
+}
+
+auto Server::execute(const Policy::Access &access, Message *input_message, Message *output_message)
+  -> size_t {
+  size_t result_length  = sizeof(Message);
+  output_message->flags = 0;
+  if (input_message->type == Message::Type::Ping) { // handle Ping requests
+    output_message->type = Message::Type::Pong;
+    auto *const input    = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    auto *const output   = reinterpret_cast<SingleEntryBody *>(output_message->data);
+    output->length       = input->length;
+    memcpy(output->data, input->data, input->length);
+    result_length += sizeof(SingleEntryBody) + output->length;
+  } else if (input_message->type == Message::Type::Add) { // handle Add requests
+    auto *const input = reinterpret_cast<DoubleEntryBody *>(input_message->data);
+    if (!access.allows({reinterpret_cast<const char *>(input->data), input->length[0]}, Policy::Write)) {
+      result_length = deny(output_message);
+    } else {
+      // stored straight from the request, so that no copy is allocated outside of the storage
+      const auto            *data = reinterpret_cast<const char *>(input->data);
+      const std::string_view key(data, input->length[0]);
+      const std::string_view value(data + input->length[0], input->length[1]);
+      const bool             evictable = input_message->flags & Message::Flags::Add_Evictable;
+      const auto             evicted   = [this](std::string_view key) {
+        this->notify(Message::Flags::Event_Evicted, key);
+      };
+      const auto stored = input_message->flags & Message::Flags::Add_ReplaceExisting
+                          ? this->storage.update(key, value, evictable, evicted)
+                          : this->storage.add(key, value, evictable, evicted);
+      if (stored == Storage::Result::Added || stored == Storage::Result::Replaced) {
+        output_message->type = Message::Type::Ok;
+        this->notify(
+          stored == Storage::Result::Added ? Message::Flags::Event_Added : Message::Flags::Event_Replaced, key
         );
+      } else if (stored == Storage::Result::OverQuota) {
+        result_length = fail(output_message, "quota exceeded");
+      } else if (stored == Storage::Result::OutOfMemory) {
+        result_length = fail(output_message, "out of locked memory");
       } else {
-        result = this->storage.add(
-          secured_string(reinterpret_cast<const char *>(input->data), input->length[0]),
-          secured_string(reinterpret_cast<const char *>(input->data + input->length[0]), input->length[1])
-        );
+        output_message->type = Message::Type::Failed;
       }
-      if (result) {
-        output_message->type = Message::Type::Ok;
+    }
+  } else if (input_message->type == Message::Type::Query) { // handle Query requests
+    auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    // whether a key exists is disclosed by listing as well, a consumed secret is deleted
+    uint8_t permissions =
+      input_message->flags & Message::Flags::Query_ExistenceOnly ? Policy::List : Policy::Read;
+    if (input_message->flags & Message::Flags::Query_DeleteSecret) {
+      permissions |= Policy::Delete;
+    }
+    if (!access.allows({reinterpret_cast<const char *>(input->data), input->length}, permissions)) {
+      result_length = deny(output_message);
+    } else {
+      const std::string_view key(reinterpret_cast<const char *>(input->data), input->length);
+      const bool             existence_only = input_message->flags & Message::Flags::Query_ExistenceOnly;
+      // the value is copied into the reply while the storage is locked, as it may be sealed right afterwards
+      const auto found = [&](std::string_view value) {
+        if (!existence_only) {
+          auto *const output = reinterpret_cast<SingleEntryBody *>(output_message->data);
+          output->length     = value.size();
+          memcpy(output->data, value.data(), output->length);
+          result_length += sizeof(SingleEntryBody) + output->length;
+        }
+      };
+      // a secret consumed by the query is taken out by the same lookup
+      bool exists = false;
+      if (input_message->flags & Message::Flags::Query_DeleteSecret) {
+        exists = this->storage.take(key, found);
+      } else if (existence_only) {
+        exists = this->storage.contains(key);
       } else {
-        output_message->type = Message::Type::Failed;
+        exists = this->storage.query(key, found);
       }
-    } else if (input_message->type == Message::Type::Query) { // handle Query requests
-      auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
-      input->receive(pair_socket);
-      const auto result =
-        this->storage.query(secured_string(reinterpret_cast<const char *>(input->data), input->length));
-      if (result == nullptr) {
+      if (!exists) {
         output_message->type = Message::Type::Failed;
       } else {
-        if (input_message->flags & Message::Flags::Query_ExistenceOnly) {
-          output_message->type = Message::Type::Ok;
-        } else {
-          output_message->type = Message::Type::Result;
-          auto *const output   = reinterpret_cast<SingleEntryBody *>(output_message->data);
-          output->length       = result->size();
-          memcpy(output->data, result->c_str(), output->length);
-          result_length += sizeof(SingleEntryBody) + output->length;
-        }
+        output_message->type = existence_only ? Message::Type::Ok : Message::Type::Result;
         if (input_message->flags & Message::Flags::Query_DeleteSecret) {
-          this->storage.remove(secured_string(reinterpret_cast<const char *>(input->data), input->length));
+          this->notify(Message::Flags::Event_Expired, key);
         }
       }
-    } else if (input_message->type == Message::Type::Delete) {
-      auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
-      input->receive(pair_socket);
-      const auto result =
-        this->storage.remove(secured_string(reinterpret_cast<const char *>(input->data), input->length));
+    }
+  } else if (input_message->type == Message::Type::Delete) {
+    auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    if (!access.allows({reinterpret_cast<const char *>(input->data), input->length}, Policy::Delete)) {
+      result_length = deny(output_message);
+    } else {
+      const auto result = this->storage.remove({reinterpret_cast<const char *>(input->data), input->length});
       if (result == 0) {
         if (input_message->flags & Message::Flags::Delete_AllowMissing) {
           output_message->type = Message::Type::Ok;
@@ -129,16 +418,708 @@ void Server::serve() {
         }
       } else {
         output_message->type = Message::Type::Ok;
+        this->notify(
+          Message::Flags::Event_Deleted, {reinterpret_cast<const char *>(input->data), input->length}
+        );
       }
-    } else if (input_message->type == Message::Type::Terminate) {
-      this->running = false;
-      close(pair_socket);
+    }
+  } else if (input_message->type == Message::Type::Stats) {
+    if (!access.allows(Policy::Admin)) {
+      result_length = deny(output_message);
+    } else {
+      const auto  summary  = this->metrics.summary(this->storage.size());
+      auto *const output   = reinterpret_cast<SingleEntryBody *>(output_message->data);
+      output_message->type = Message::Type::Result;
+      output->length =
+        std::min(summary.size(), MessageBufferSize - sizeof(Message) - sizeof(SingleEntryBody));
+      memcpy(output->data, summary.data(), output->length);
+      result_length += sizeof(SingleEntryBody) + output->length;
+    }
+  } else {
+    output_message->type = Message::Type::Failed;
+  }
+  return result_length;
+}
+
+auto Server::attach(Reactor &reactor, int pair_socket, const Policy::Access &access) -> bool {
+  {
+    std::lock_guard<std::mutex> lock(this->channels_mutex);
+    if (this->channels >= MaxChannels) {
+      return false;
+    }
+    this->channels++;
+  }
+  const int   memfd   = Channel::create();
+  auto *const channel = memfd == -1 ? nullptr : Channel::map(memfd);
+  if (channel == nullptr) {
+    if (memfd != -1) {
+      close(memfd);
+    }
+    this->close_channel();
+    return false;
+  }
+  uint8_t     buffer[sizeof(Message)];
+  auto *const reply = reinterpret_cast<Message *>(buffer);
+  reply->type       = Message::Type::Ok;
+  reply->flags      = 0;
+  iovec  iov{buffer, sizeof(buffer)};
+  msghdr header{};
+  // the memfd is passed as ancillary data of the reply
+  alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(memfd))]{};
+  header.msg_iov        = &iov;
+  header.msg_iovlen     = 1;
+  header.msg_control    = control;
+  header.msg_controllen = sizeof(control);
+  auto *const rights    = CMSG_FIRSTHDR(&header);
+  rights->cmsg_level    = SOL_SOCKET;
+  rights->cmsg_type     = SCM_RIGHTS;
+  rights->cmsg_len      = CMSG_LEN(sizeof(memfd));
+  memcpy(CMSG_DATA(rights), &memfd, sizeof(memfd));
+  const bool sent = sendmsg(pair_socket, &header, MSG_NOSIGNAL) == sizeof(buffer);
+  // the client holds the memfd now, the channel stays mapped on both sides without it
+  close(memfd);
+  if (!sent) {
+    Channel::unmap(channel);
+    this->close_channel();
+    return false;
+  }
+  // like any other thread but the first reactor, the channel thread takes no signal
+  //  it is neither pinned nor given an arena on a node, as the keys of a channel fall into every partition,
+  //   what it allocates comes from the shared arena, and what it frees goes back into the arena owning it
+  sigset_t all;
+  sigset_t blocked;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &blocked);
+  std::thread(&Server::serve_channel, this, pair_socket, channel, access, reactor.connection).detach();
+  pthread_sigmask(SIG_SETMASK, &blocked, nullptr);
+  reactor.handed_off = true;
+  return true;
+}
+
+void Server::serve_channel(int pair_socket, Channel *channel, Policy::Access access, uint64_t connection) {
+  HardenedMemoryAllocator<uint8_t> allocator;
+  auto *const input_message  = reinterpret_cast<Message *>(allocator.allocate(MessageBufferSize));
+  auto *const output_message = reinterpret_cast<Message *>(allocator.allocate(MessageBufferSize));
+  // the channel is new, while the client may have posted a request into it already
+  uint32_t seen = 0;
+  while (this->running.load(std::memory_order_relaxed)) {
+    if (!channel->request.wait(seen)) {
+      // the client sends nothing over the connection any more, so anything on it is a hang up
+      pollfd descriptor{pair_socket, POLLIN, 0};
+      if (poll(&descriptor, 1, 0) != 0) {
+        break;
+      }
+      continue;
+    }
+    seen = channel->request.sequence.load(std::memory_order_acquire);
+    TRACE_SCOPE("channel");
+    const auto begin = std::chrono::steady_clock::now();
+    // copied out before anything is checked, as the client may change it at any time
+    const auto length = std::min<size_t>(channel->request.length, MessageBufferSize);
+    memcpy(input_message, channel->request.data, length);
+    size_t result_length = sizeof(Message);
+    if (well_formed(input_message, length)) {
+      result_length = this->execute(access, input_message, output_message);
+    } else {
+      output_message->type  = Message::Type::Failed;
+      output_message->flags = 0;
+    }
+    memcpy(channel->reply.data, output_message, result_length);
+    channel->reply.post(result_length);
+    this->metrics.record(
+      input_message->type,
+      std::chrono::steady_clock::now() - begin,
+      output_message->type == Message::Type::Failed
+    );
+    if (this->capture != nullptr) {
+      this->capture->record(connection, begin, input_message, output_message);
+    }
+  }
+  Channel::unmap(channel);
+  close(pair_socket);
+  allocator.deallocate(reinterpret_cast<uint8_t *>(input_message), -1);
+  allocator.deallocate(reinterpret_cast<uint8_t *>(output_message), -1);
+  this->close_channel();
+}
+
+void Server::close_channel() {
+  std::lock_guard<std::mutex> lock(this->channels_mutex);
+  if (--this->channels == 0) {
+    this->channels_closed.notify_all();
+  }
+}
+
+// write the message mirroring a change of the secret of key into buffer, return its length, or 0 if it does
+//  not fit into a message, as a secret loaded on startup may not
+static auto replication_message(
+  uint8_t *buffer, std::string_view key, std::optional<std::string_view> value, bool evictable
+) -> size_t {
+  auto *const message = reinterpret_cast<Message *>(buffer);
+  if (!value.has_value()) {
+    const auto length = sizeof(Message) + sizeof(SingleEntryBody) + key.size();
+    if (length > MessageBufferSize) {
+      return 0;
+    }
+    message->type    = Message::Type::Delete;
+    message->flags   = Message::Flags::Delete_AllowMissing;
+    auto *const body = reinterpret_cast<SingleEntryBody *>(message->data);
+    body->length     = key.size();
+    memcpy(body->data, key.data(), key.size());
+    return length;
+  }
+  const auto length = sizeof(Message) + sizeof(DoubleEntryBody) + key.size() + value->size();
+  if (length > MessageBufferSize) {
+    return 0;
+  }
+  message->type    = Message::Type::Add;
+  message->flags   = Message::Flags::Add_ReplaceExisting | (evictable ? Message::Flags::Add_Evictable : 0);
+  auto *const body = reinterpret_cast<DoubleEntryBody *>(message->data);
+  body->length[0]  = key.size();
+  body->length[1]  = value->size();
+  memcpy(body->data, key.data(), key.size());
+  memcpy(body->data + key.size(), value->data(), value->size());
+  return length;
+}
+
+void Server::replicate(std::string_view key, std::optional<std::string_view> value, bool evictable) {
+  if (this->replica_count.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  // a buffer of each thread changing the storage, in locked memory as it holds the value
+  //  nothing may be thrown at the storage, which invokes this in the middle of a change, so every replica is
+  //   dropped if there is no memory left for it
+  thread_local std::vector<uint8_t, HardenedMemoryAllocator<uint8_t>> buffer;
+  bool                                                                allocated = true;
+  try {
+    buffer.resize(MessageBufferSize);
+  } catch (const std::bad_alloc &) {
+    allocated = false;
+  }
+  const auto length = allocated ? replication_message(buffer.data(), key, value, evictable) : 0;
+  if (allocated && length == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->replicas_mutex);
+    for (auto &replica : this->replicas) {
+      if (replica.dropped) {
+        continue;
+      }
+      bool kept = false;
+      if (allocated && replica.transferring) {
+        try {
+          kept = replica.backlog.size() + length <= MaxBacklog;
+          if (kept) {
+            replica.backlog.insert(replica.backlog.end(), buffer.data(), buffer.data() + length);
+          }
+        } catch (const std::bad_alloc &) {
+          kept = false;
+        }
+      } else if (allocated) {
+        kept = send(replica.socket, buffer.data(), length, MSG_NOSIGNAL | MSG_DONTWAIT)
+               == static_cast<ssize_t>(length);
+      }
+      // a replica that does not keep up is dropped rather than allowed to stall the server, as its standby
+      //  connects again and starts over
+      if (!kept) {
+        replica.dropped = true;
+        shutdown(replica.socket, SHUT_RDWR);
+      }
+    }
+  }
+  // the value is not left behind until the next change
+  if (allocated) {
+    explicit_bzero(buffer.data(), length);
+  }
+}
+
+auto Server::attach_replica(Reactor &reactor, int pair_socket) -> bool {
+  {
+    std::lock_guard<std::mutex> lock(this->replicas_mutex);
+    if (this->replicas.size() >= MaxReplicas) {
+      return false;
+    }
+    // changes are journaled into its backlog from now on, before any secret is sent
+    this->replicas.push_back({pair_socket});
+    this->replica_count.store(this->replicas.size(), std::memory_order_relaxed);
+  }
+  // like any other thread but the first reactor, the replica thread takes no signal
+  sigset_t all;
+  sigset_t blocked;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &blocked);
+  std::thread(&Server::serve_replica, this, pair_socket).detach();
+  pthread_sigmask(SIG_SETMASK, &blocked, nullptr);
+  reactor.handed_off = true;
+  return true;
+}
+
+void Server::serve_replica(int pair_socket) {
+  // secrets are packed into a buffer of several messages, sent whenever it may not take another one
+  static constexpr size_t          BufferSize = 16 * MessageBufferSize;
+  HardenedMemoryAllocator<uint8_t> allocator;
+  auto *const                      buffer = allocator.allocate(BufferSize);
+  size_t                           used   = 0;
+  bool                             sent   = true;
+  const auto                       flush  = [&]() {
+    sent = sent && send(pair_socket, buffer, used, MSG_NOSIGNAL) == static_cast<ssize_t>(used);
+    used = 0;
+  };
+  // secrets are copied into the buffer with their partition locked, and the buffer is sent with the storage
+  //  unlocked, so that a standby slow to take them never stalls a partition
+  try {
+    Storage::Cursor cursor;
+    bool            left = true;
+    while (sent && left) {
+      left = this->storage.replay(cursor, [&](std::string_view key, std::string_view value, bool evictable) {
+        if (used + MessageBufferSize > BufferSize) {
+          return false;
+        }
+        used += replication_message(buffer + used, key, value, evictable);
+        return true;
+      });
+      if (left) {
+        flush();
+      }
+    }
+  } catch (const std::bad_alloc &) {
+    sent = false;
+  }
+  auto *const done = reinterpret_cast<Message *>(buffer + used);
+  done->type       = Message::Type::Ok;
+  done->flags      = 0;
+  used += sizeof(Message);
+  flush();
+  allocator.deallocate(buffer, BufferSize);
+  // the backlog is taken out and sent with the replicas unlocked, while changes made meanwhile keep being
+  //  appended to it, until it is found empty, after which changes are sent as they are made
+  decltype(Replica::backlog) backlog;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(this->replicas_mutex);
+      auto &replica = *std::ranges::find(this->replicas, pair_socket, &Replica::socket);
+      if (!sent || replica.dropped || replica.backlog.empty()) {
+        replica.transferring = false;
+        decltype(replica.backlog)().swap(replica.backlog);
+        if (!sent && !replica.dropped) {
+          replica.dropped = true;
+          shutdown(pair_socket, SHUT_RDWR);
+        }
+        break;
+      }
+      backlog.swap(replica.backlog);
+    }
+    sent = send(pair_socket, backlog.data(), backlog.size(), MSG_NOSIGNAL)
+           == static_cast<ssize_t>(backlog.size());
+    backlog.clear();
+  }
+  // the standby sends nothing, so anything on the connection is a hang up, or the replica being shut down
+  pollfd descriptor{pair_socket, POLLIN, 0};
+  while (poll(&descriptor, 1, -1) == -1 && errno == EINTR) {
+  }
+  std::lock_guard<std::mutex> lock(this->replicas_mutex);
+  std::erase_if(this->replicas, [pair_socket](const Replica &other) { return other.socket == pair_socket; });
+  this->replica_count.store(this->replicas.size(), std::memory_order_relaxed);
+  close(pair_socket);
+  this->replicas_closed.notify_all();
+}
+
+auto Server::handle(
+  Reactor              &reactor,
+  int                   pair_socket,
+  const Policy::Access &access,
+  MessageReceiver      &receiver,
+  Message              *output_message,
+  bool                  batched
+) -> bool {
+  if (!receiver.receive()) {
+    return false;
+  }
+  auto *const input_message = receiver.message();
+  TRACE_SCOPE(message_type_name(input_message->type));
+  const auto begin         = std::chrono::steady_clock::now();
+  size_t     result_length = sizeof(Message);
+  bool       usable        = true;
+  output_message->flags    = 0;
+
+  if (self_contained(input_message->type)) {
+    // received whole, then executed just like a request taken over a channel
+    result_length = this->execute(access, input_message, output_message);
+  } else if (input_message->type == Message::Type::ListPrefix) {
+    auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    const std::string_view prefix(reinterpret_cast<const char *>(input->data), input->length);
+    if (!access.allows_prefix(prefix, Policy::List)) {
+      result_length = deny(output_message);
+    } else {
+      // keys are collected first and sent with the storage unlocked, so that a client that stops reading
+      //  never holds up requests on the partitions
+      std::vector<secured_string, HardenedMemoryAllocator<secured_string>> keys;
+      bool                                                                 listed = true;
+      try {
+        this->storage.list_prefix(prefix, [&](std::string_view key) { keys.emplace_back(key); });
+      } catch (const std::bad_alloc &) {
+        listed = false;
+      }
+      if (!listed) {
+        result_length = fail(output_message, "out of memory");
+      } else {
+        // keys are packed as consecutive Result messages, flushed whenever the buffer is full
+        auto *const buffer = reinterpret_cast<uint8_t *>(output_message);
+        result_length      = 0;
+        for (const auto &key : keys) {
+          const size_t length = sizeof(Message) + sizeof(SingleEntryBody) + key.size();
+          // a key that does not fit into a message, as one loaded on startup may not, is left out
+          if (length > MessageBufferSize) {
+            continue;
+          }
+          if (result_length + length > MessageBufferSize) {
+            send(pair_socket, buffer, result_length, MSG_NOSIGNAL);
+            result_length = 0;
+          }
+          auto *const message = reinterpret_cast<Message *>(buffer + result_length);
+          message->type       = Message::Type::Result;
+          message->flags      = 0;
+          auto *const output  = reinterpret_cast<SingleEntryBody *>(message->data);
+          output->length      = key.size();
+          memcpy(output->data, key.data(), key.size());
+          result_length += length;
+        }
+        if (result_length + sizeof(Message) > MessageBufferSize) {
+          send(pair_socket, buffer, result_length, MSG_NOSIGNAL);
+          result_length = 0;
+        }
+        auto *const message = reinterpret_cast<Message *>(buffer + result_length);
+        message->type       = Message::Type::Ok;
+        message->flags      = 0;
+        result_length += sizeof(Message);
+      }
+    }
+  } else if (input_message->type == Message::Type::DeletePrefix) {
+    auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    const std::string_view prefix(reinterpret_cast<const char *>(input->data), input->length);
+    if (!access.allows_prefix(prefix, Policy::Delete)) {
+      result_length = deny(output_message);
+    } else {
+      const uint64_t result = this->storage.remove_prefix(prefix, [this](std::string_view key) {
+        this->notify(Message::Flags::Event_Deleted, key);
+      });
+      output_message->type  = Message::Type::Result;
+      auto *const output    = reinterpret_cast<SingleEntryBody *>(output_message->data);
+      output->length        = sizeof(result);
+      memcpy(output->data, &result, sizeof(result));
+      result_length += sizeof(SingleEntryBody) + output->length;
+    }
+  } else if (input_message->type == Message::Type::Batch && !batched) {
+    auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    uint32_t count = 0;
+    if (input->length == sizeof(count)) {
+      memcpy(&count, input->data, sizeof(count));
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      if (!this->handle(reactor, pair_socket, access, receiver, output_message, true)) {
+        return false;
+      }
+    }
+    return true;
+  } else if (input_message->type == Message::Type::Watch) {
+    auto *const input = reinterpret_cast<SingleEntryBody *>(input_message->data);
+    const std::string_view pattern(reinterpret_cast<const char *>(input->data), input->length);
+    const bool             prefix = input_message->flags & Message::Flags::Watch_Prefix;
+    // events disclose as much as listing does
+    if (prefix ? !access.allows_prefix(pattern, Policy::List) : !access.allows(pattern, Policy::List)) {
+      result_length = deny(output_message);
+    } else if (this->watcher_count.load(std::memory_order_relaxed) + reactor.registering.size()
+               >= MaxWatchers) {
+      output_message->type = Message::Type::Failed;
+    } else {
+      reactor.registering.push_back({pair_socket, secured_string(pattern), prefix});
+      output_message->type = Message::Type::Ok;
+    }
+  } else if (input_message->type == Message::Type::Attach && !batched) {
+    if (this->attach(reactor, pair_socket, access)) {
+      // the reply carrying the memfd is sent already, and the connection belongs to the channel from now on
+      this->metrics.record(input_message->type, std::chrono::steady_clock::now() - begin, false);
+      return true;
+    }
+    output_message->type = Message::Type::Failed;
+  } else if (input_message->type == Message::Type::Replicate && !batched) {
+    if (!access.allows(Policy::Admin)) {
+      result_length = deny(output_message);
+    } else if (this->attach_replica(reactor, pair_socket)) {
+      // secrets are sent by the thread serving the replica, which the connection belongs to from now on
+      this->metrics.record(input_message->type, std::chrono::steady_clock::now() - begin, false);
+      return true;
+    } else {
+      output_message->type = Message::Type::Failed;
+    }
+  } else if (input_message->type == Message::Type::Terminate && !batched) {
+    if (access.allows(Policy::Admin)) {
+      this->stop();
+      return false;
+    }
+    result_length = deny(output_message);
+  } else {
+    // a request of an unknown type, or one not allowed here such as a nested Batch, is replied but ends the
+    //  connection, as whatever follows it, e.g. the rest of a batch, cannot be trusted to be framed as meant
+    output_message->type = Message::Type::Failed;
+    usable               = false;
+  }
+
+  {
+    TRACE_SCOPE("send", result_length);
+    send(pair_socket, output_message, result_length, MSG_NOSIGNAL);
+  }
+  this->metrics.record(
+    input_message->type,
+    std::chrono::steady_clock::now() - begin,
+    output_message->type == Message::Type::Failed
+  );
+  if (this->capture != nullptr) {
+    this->capture->record(reactor.connection, begin, input_message, output_message);
+  }
+  return usable;
+}
+
+void Server::admit(Reactor &reactor) {
+  TRACE_SCOPE("accept");
+  const auto queued = reactor.queue.size();
+  while (true) {
+    const int pair_socket = accept(reactor.socket_fd, nullptr, nullptr);
+    if (pair_socket == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // nothing left in the backlog
       break;
     }
+    Pending   connection{pair_socket, {}, this->next_connection.fetch_add(1, std::memory_order_relaxed)};
+    ucred     credentials{};
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(pair_socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0) {
+      connection.credentials = credentials;
+    }
+    // peers that cannot be identified share a limit
+    const auto from_peer = std::ranges::count_if(reactor.queue, [&](const Pending &other) {
+      return other.credentials.has_value() == connection.credentials.has_value()
+             && (!other.credentials.has_value() || other.credentials->uid == connection.credentials->uid);
+    });
+    if (reactor.queue.size() >= this->max_queued || static_cast<size_t>(from_peer) >= this->max_per_peer) {
+      this->reject(reactor, pair_socket);
+      continue;
+    }
+    reactor.queue.push_back(connection);
+  }
+  this->metrics.queued_connections.fetch_add(reactor.queue.size() - queued, std::memory_order_relaxed);
+}
+
+void Server::reject(const Reactor &reactor, int pair_socket) {
+  this->metrics.rejected_connections.fetch_add(1, std::memory_order_relaxed);
+  // by then the connections queued ahead have been served at the pace seen recently
+  const auto wait = std::max<int64_t>(
+    1,
+    std::chrono::duration_cast<std::chrono::milliseconds>(reactor.service_time * reactor.queue.size()).count()
+  );
+  uint8_t     buffer[sizeof(Message) + sizeof(SingleEntryBody) + 64];
+  auto *const message = reinterpret_cast<Message *>(buffer);
+  message->type       = Message::Type::Failed;
+  message->flags      = Message::Flags::Failed_DescriptionAttached | Message::Flags::Failed_Busy;
+  auto *const body    = reinterpret_cast<SingleEntryBody *>(message->data);
+  auto *const text    = reinterpret_cast<char *>(body->data);
+  body->length        = std::format_to_n(text, 64, "busy, retry in {} ms", wait).size;
+  // the reply fits into an empty socket buffer, and the request is never read, so that rejecting costs
+  //  no more than accepting
+  const auto length = sizeof(Message) + sizeof(SingleEntryBody) + body->length;
+  send(pair_socket, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+  close(pair_socket);
+}
 
-    send(pair_socket, output_message, result_length, 0);
+void Server::serve_connection(
+  Reactor                  &reactor,
+  const Pending            &connection,
+  std::chrono::milliseconds timeout,
+  Message                  *input_message,
+  Message                  *output_message
+) {
+  const auto started     = std::chrono::steady_clock::now();
+  const auto pair_socket = connection.socket;
+  reactor.connection     = connection.id;
+  this->metrics.connections.fetch_add(1, std::memory_order_relaxed);
+  this->metrics.active_connections.fetch_add(1, std::memory_order_relaxed);
+  // a client that stalls in the middle of a request is dropped instead of blocking every other client
+  const timeval deadline{
+    .tv_sec  = static_cast<time_t>(timeout.count() / 1000),
+    .tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000),
+  };
+  setsockopt(pair_socket, SOL_SOCKET, SO_RCVTIMEO, &deadline, sizeof(deadline));
+  setsockopt(pair_socket, SOL_SOCKET, SO_SNDTIMEO, &deadline, sizeof(deadline));
+  MessageReceiver receiver(pair_socket, input_message);
+  const bool usable = this->handle(
+    reactor, pair_socket, this->authorize(connection.credentials), receiver, output_message, false
+  );
+  if (reactor.handed_off) {
+    reactor.handed_off = false;
+  } else if (!usable || reactor.registering.empty()) {
+    // a connection failing partway, e.g. a batch with a bad request, is closed with nothing it registered
+    reactor.registering.clear();
     close(pair_socket);
+  } else {
+    std::lock_guard<std::mutex> lock(this->watchers_mutex);
+    std::ranges::move(reactor.registering, std::back_inserter(this->watchers));
+    this->watcher_count.store(this->watchers.size(), std::memory_order_relaxed);
+    reactor.registering.clear();
+    reactor.watching.push_back(pair_socket);
+  }
+  this->metrics.active_connections.fetch_sub(1, std::memory_order_relaxed);
+  reactor.service_time += (std::chrono::steady_clock::now() - started - reactor.service_time) / 8;
+}
+
+void Server::drain(Reactor &reactor, Message *input_message, Message *output_message) {
+  // new clients can no longer find the socket, while those already queued on it are still served, unless
+  //  the socket is inherited, in which case they are left to the next instance taking it over
+  //  the address is forgotten once removed, as a standby may take it over before this process exits
+  if (!reactor.inherited) {
+    std::filesystem::remove(reactor.address);
+    reactor.address.clear();
+  }
+  const auto deadline = std::chrono::steady_clock::now() + this->grace_period;
+  while (true) {
+    const auto remaining =
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      break;
+    }
+    if (!reactor.inherited) {
+      this->admit(reactor);
+    }
+    if (reactor.queue.empty()) {
+      break;
+    }
+    const auto connection = reactor.queue.front();
+    reactor.queue.pop_front();
+    this->metrics.queued_connections.fetch_sub(1, std::memory_order_relaxed);
+    this->serve_connection(
+      reactor, connection, std::min(this->io_timeout, remaining), input_message, output_message
+    );
   }
+  // clients still waiting when the grace period runs out see the connection closed
+  for (const auto &connection : reactor.queue) {
+    close(connection.socket);
+  }
+  this->metrics.queued_connections.fetch_sub(reactor.queue.size(), std::memory_order_relaxed);
+  reactor.queue.clear();
+}
+
+// pin the calling thread for the index-th reactor and return the NUMA node it runs on
+//  reactors are spread over nodes in turn, so that every node serves its share, and over the cores of each
+//   node, wrapping around if there are fewer cores
+static auto pin(size_t index) -> int {
+  static const auto nodes = numa_nodes();
+  const auto       &node  = nodes[index % nodes.size()];
+  if (node.cpus.empty()) {
+    return node.id;
+  }
+  cpu_set_t pinned;
+  CPU_ZERO(&pinned);
+  CPU_SET(node.cpus[index / nodes.size() % node.cpus.size()], &pinned);
+  pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+  return node.id;
+}
+
+void Server::run(Reactor &reactor, const sigset_t *signals) {
+  if (this->reactors.size() > 1) {
+    const auto node = pin(reactor.index);
+    // the first reactor keeps the arena shared with the rest of the process, e.g. secrets loaded on startup,
+    //  while any other one allocates the secrets of its partition from pages on its own node
+    if (reactor.index > 0) {
+      HardenedMemoryManager::use_arena(HardenedMemoryManager::create_arena(node));
+      if (this->reserve_locked != 0 && !HardenedMemoryManager::reserve(this->reserve_locked)) {
+        std::println(stderr, "failed to reserve locked memory for reactor {}!", reactor.index);
+        this->stop();
+      }
+    }
+  }
+  HardenedMemoryAllocator<uint8_t> allocator;
+  auto *const input_message  = reinterpret_cast<Message *>(allocator.allocate(MessageBufferSize));
+  auto *const output_message = reinterpret_cast<Message *>(allocator.allocate(MessageBufferSize));
+  std::vector<pollfd> descriptors;
+  while (this->running.load(std::memory_order_relaxed)) {
+    descriptors.assign({{reactor.socket_fd, POLLIN, 0}, {reactor.wakeup_fd, POLLIN, 0}});
+    for (const auto socket : reactor.watching) {
+      descriptors.push_back({socket, POLLIN, 0});
+    }
+    // with connections queued, only what arrived meanwhile and signals pending are picked up without waiting
+    const timespec immediately{0, 0};
+    if (ppoll(descriptors.data(), descriptors.size(), reactor.queue.empty() ? nullptr : &immediately, signals)
+        == -1) {
+      if (errno == EINTR) {
+        this->stop();
+        break;
+      }
+      continue;
+    }
+    // watchers send nothing after registering, so anything on them is a hang up or a protocol violation
+    for (size_t i = 2; i < descriptors.size(); i++) {
+      if (descriptors[i].revents != 0) {
+        this->unwatch(reactor, descriptors[i].fd);
+      }
+    }
+    if (descriptors.front().revents & POLLIN) {
+      this->admit(reactor);
+    }
+    if (reactor.queue.empty()) {
+      continue;
+    }
+    const auto connection = reactor.queue.front();
+    reactor.queue.pop_front();
+    this->metrics.queued_connections.fetch_sub(1, std::memory_order_relaxed);
+    this->serve_connection(reactor, connection, this->io_timeout, input_message, output_message);
+  }
+  this->drain(reactor, input_message, output_message);
   allocator.deallocate(reinterpret_cast<uint8_t *>(input_message), -1);
   allocator.deallocate(reinterpret_cast<uint8_t *>(output_message), -1);
+}
+
+void Server::serve() {
+  // SIGINT and SIGTERM are only delivered to the first reactor while waiting for connections, so a request
+  //  being handled is never interrupted, and shutdown begins right after it
+  sigset_t mask;
+  sigset_t original;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &original);
+  // no signal is left to the metrics thread and the other reactors
+  sigset_t all;
+  sigset_t blocked;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &blocked);
+  if (this->metrics_fd != -1) {
+    this->metrics_thread = std::thread(&Server::serve_metrics, this);
+  }
+  for (size_t i = 1; i < this->reactors.size(); i++) {
+    this->reactors[i].thread =
+      std::thread(&Server::run, this, std::ref(this->reactors[i]), static_cast<const sigset_t *>(nullptr));
+  }
+  pthread_sigmask(SIG_SETMASK, &blocked, nullptr);
+  this->run(this->reactors.front(), &original);
+  for (size_t i = 1; i < this->reactors.size(); i++) {
+    this->reactors[i].thread.join();
+  }
+  // channel threads see shutdown within a sleep at most
+  {
+    std::unique_lock<std::mutex> lock(this->channels_mutex);
+    this->channels_closed.wait(lock, [this]() { return this->channels == 0; });
+  }
+  // replicas are closed last, so that standbys get every change made, and take over only once nothing is
+  //  served any more
+  {
+    std::unique_lock<std::mutex> lock(this->replicas_mutex);
+    for (const auto &replica : this->replicas) {
+      shutdown(replica.socket, SHUT_RDWR);
+    }
+    this->replicas_closed.wait(lock, [this]() { return this->replicas.empty(); });
+  }
+  // nothing is served any more, so every request is written out by then
+  this->capture.reset();
+  pthread_sigmask(SIG_SETMASK, &original, nullptr);
 }
\ No newline at end of file
@@ -1,21 +1,217 @@
 #ifndef SERVER_HH_
 #define SERVER_HH_
+#include "capture.hh"
+#include "metrics.hh"
+#include "policy.hh"
 #include "storage.hh"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <signal.h>
+#include <string_view>
+#include <sys/un.h>
+#include <thread>
+#include <vector>
+struct Message;
+class MessageReceiver;
+class Channel;
 class Server {
 public:
   static auto build(Storage &storage) -> Server &;
 
   ~Server();
+  // listen on a socket created at address, or on the socket passed by a service manager through LISTEN_FDS
+  //  if there is one, which is then never removed
+  //  with several reactors, reactor N listens on address.N, or on the socket passed in position N
   auto start(const char *address = nullptr) -> bool;
+  // expose metrics in prometheus text format over HTTP on another socket, served once serve is called
+  auto start_metrics(const char *address) -> bool;
+  // authorize requests by the policy instead of granting everything to anyone who can reach the socket
+  void enforce(Policy &&policy);
+  // record an anonymized trace of the requests served into a new file at path, until serve returns
+  //  must be called after daemonizing, as it starts a thread of its own
+  auto start_capture(const char *path) -> bool;
+  // bound every read and write on a connection by io_timeout, and the time spent serving connections
+  //  already queued once shutdown begins by grace_period
+  void set_deadlines(std::chrono::milliseconds io_timeout, std::chrono::milliseconds grace_period);
+  // listen with a backlog of that many connections, and keep at most max_queued of them accepted and waiting
+  //  to be served, at most max_per_peer of which from the same user, any other one is replied busy right away
+  //  instead of waiting without bound, must be called before start
+  void set_limits(int backlog, size_t max_queued, size_t max_per_peer);
+  // serve with count reactors, the storage shall have as many partitions, must be called before start
+  void set_reactors(size_t count);
+  // reserve bytes of locked memory in the arena of every reactor but the first once it is created, shutting
+  //  down if they cannot be locked, the first one uses the arena reserved into on startup
+  void set_reserve(size_t bytes);
+  // serve until Terminate is requested or SIGINT or SIGTERM is received, then drain the queued connections
   void serve();
 
 private:
   Storage &storage;
-  int socket_fd{-1};
-  std::filesystem::path address;
-  bool running{true};
+  // set once shutdown begins, by whichever reactor sees it first
+  std::atomic<bool> running{true};
+
+  std::chrono::milliseconds io_timeout{5000};
+  std::chrono::milliseconds grace_period{5000};
+
+  int    backlog{128};
+  size_t max_queued{64};
+  size_t max_per_peer{16};
+  Metrics               metrics;
+  int                   metrics_fd{-1};
+  std::filesystem::path metrics_address;
+  std::thread           metrics_thread;
+
+  std::optional<Policy> policy;
+
+  std::unique_ptr<Capture> capture;
+  // connections are numbered as they are accepted, so that captured requests tell which one they came over
+  std::atomic<uint64_t> next_connection{0};
+
+  // connections kept open to push events through, with one entry per key or prefix watched
+  //  entries of a connection are adjacent as all of them are registered while it is handled
+  struct Watcher {
+    int            socket;
+    secured_string pattern;
+    bool           prefix;
+  };
+  static constexpr size_t MaxWatchers = 1024;
+  std::vector<Watcher>    watchers;
+  // watchers are shared by all reactors, while notifying takes no lock as long as nobody watches
+  //  the mutex is the one lock every reactor contends on once anyone watches, it is not sharded by partition
+  //   as a prefix watched matches keys of every partition, so each change would still visit every shard
+  std::mutex              watchers_mutex;
+  std::atomic<size_t>     watcher_count{0};
+
+  // connections accepted but not served yet, with the credentials of their peers unless they are unknown
+  struct Pending {
+    int                  socket;
+    std::optional<ucred> credentials;
+    uint64_t             id;
+  };
+
+  // a thread serving connections on a socket of its own, which clients send requests on keys of the partition
+  //  of the storage with the same index to, pinned to a core and allocating from an arena of its own when
+  //  there are several of them, spread over NUMA nodes with each arena placed on the node of its reactor
+  //  the first reactor runs on the thread calling serve, the only one signals are delivered to
+  struct Reactor {
+    size_t                index{0};
+    int                   socket_fd{-1};
+    std::filesystem::path address;
+    // the socket is passed by a service manager, so it is never removed and outlives this process
+    bool inherited{false};
+    // an eventfd written to wake the reactor up, e.g. as shutdown begins on another reactor
+    int                 wakeup_fd{-1};
+    std::deque<Pending> queue;
+    // moving average of the time spent on a connection, to tell busy clients how long to wait
+    std::chrono::nanoseconds service_time{0};
+    // connections watching anything registered by this reactor, which it polls for hang ups
+    std::vector<int> watching;
+    // watchers registered by the connection being served, only published once all replies to it are sent,
+    //  so that no event pushed by another reactor comes in between
+    std::vector<Watcher> registering;
+    // the connection being served was handed off to a thread serving a channel, which closes it
+    bool handed_off{false};
+    // number of the connection being served
+    uint64_t    connection{0};
+    std::thread thread;
+  };
+  size_t               reactor_count{1};
+  size_t               reserve_locked{0};
+  std::vector<Reactor> reactors;
+
+  // channels attached, each served by a thread of its own until its client hangs up or shutdown begins
+  static constexpr size_t MaxChannels = 64;
+  size_t                  channels{0};
+  std::mutex              channels_mutex;
+  std::condition_variable channels_closed;
+
+  // standbys mirroring the storage, each fed every change as it is made, see Message::Type::Replicate
+  struct Replica {
+    int socket;
+    // secrets held are being sent, while changes made meanwhile are appended to the backlog to follow them
+    bool                                                   transferring{true};
+    std::vector<uint8_t, HardenedMemoryAllocator<uint8_t>> backlog;
+    // shut down for lagging behind, to be closed by the thread serving it
+    bool dropped{false};
+  };
+  static constexpr size_t MaxReplicas = 4;
+  static constexpr size_t MaxBacklog  = 1 << 20;
+  std::vector<Replica>    replicas;
+  // replicas are shared by all reactors, while journaling takes no lock as long as there are none
+  //  the lock is taken with partitions of the storage locked, so no partition is ever locked while holding it
+  std::mutex              replicas_mutex;
+  std::atomic<size_t>     replica_count{0};
+  std::condition_variable replicas_closed;
 
   Server(Storage &storage);
+
+  // create, bind and listen on a socket of our own for reactor
+  auto listen_on(Reactor &reactor, const sockaddr_un &address) -> bool;
+  // serve connections on the socket of reactor until shutdown begins, with signals unblocked while waiting
+  //  for connections if signals is given
+  void run(Reactor &reactor, const sigset_t *signals);
+  // begin shutting down, waking every reactor up
+  void stop();
+
+  void serve_metrics();
+
+  // accept every connection waiting in the backlog into the queue, or reject it if there is no room left
+  void admit(Reactor &reactor);
+  // reply busy without reading the request and close the connection
+  void reject(const Reactor &reactor, int pair_socket);
+  // serve a connection accepted with reads and writes bounded by timeout
+  void serve_connection(
+    Reactor                  &reactor,
+    const Pending            &connection,
+    std::chrono::milliseconds timeout,
+    Message                  *input_message,
+    Message                  *output_message
+  );
+  // stop accepting new connections and serve those already queued until the grace period runs out
+  void drain(Reactor &reactor, Message *input_message, Message *output_message);
+
+  // push an Event message with flags event to every connection watching key
+  //  a connection that fails to take it is shut down, to be unwatched by the reactor polling it
+  //  keys too long to fit into a message are not pushed
+  void notify(uint8_t event, std::string_view key);
+  // stop pushing events through a connection of reactor and close it
+  void unwatch(Reactor &reactor, int socket);
+
+  // open a channel for the connection and reply the memfd of it, return false if it cannot be opened
+  auto attach(Reactor &reactor, int pair_socket, const Policy::Access &access) -> bool;
+  // serve requests taken over a channel until its client hangs up or shutdown begins
+  void serve_channel(int pair_socket, Channel *channel, Policy::Access access, uint64_t connection);
+  // account for a channel served no longer
+  void close_channel();
+
+  // push a change of the storage to every replica, invoked with the partition of key locked
+  //  a replica that fails to take it is shut down, to be closed by the thread serving it
+  void replicate(std::string_view key, std::optional<std::string_view> value, bool evictable);
+  // hand the connection off to a thread mirroring the storage into it, return false if there is no room
+  auto attach_replica(Reactor &reactor, int pair_socket) -> bool;
+  // send every secret held and then the backlog, and keep the replica until its client hangs up or it is
+  //  shut down
+  void serve_replica(int pair_socket);
+  // execute a self contained request, one replied by a single message, return the length of the reply
+  auto execute(const Policy::Access &access, Message *input_message, Message *output_message) -> size_t;
+
+  // decisions of the policy for the peer of a connection
+  [[nodiscard]] auto authorize(const std::optional<ucred> &credentials) const -> Policy::Access;
+
+  // handle one request on the connection, return false if the connection shall not be used any more
+  auto handle(
+    Reactor              &reactor,
+    int                   pair_socket,
+    const Policy::Access &access,
+    MessageReceiver      &receiver,
+    Message              *output_message,
+    bool                  batched
+  ) -> bool;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include "snapshot.hh"
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/keyctl.h>
+#include <openssl/evp.h>
+#include <print>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr char     Magic[8]            = {'S', 'S', 'S', 'N', 'A', 'P', '\0', '\1'};
+constexpr uint32_t PassphraseIterations = 600000;
+// keyring entries are expected to hold random key material, no stretching required
+constexpr uint32_t KeyringIterations = 1;
+constexpr size_t   KeyLength         = 32;
+constexpr size_t   IVLength          = 12;
+constexpr size_t   TagLength         = 16;
+
+// secrets decrypted from a snapshot, held in locked memory until they are stored
+using SecretList = std::vector<
+  std::pair<secured_string, secured_string>,
+  HardenedMemoryAllocator<std::pair<secured_string, secured_string>>>;
+
+struct SnapshotHeader {
+  char     magic[sizeof(Magic)];
+  uint32_t iterations;
+  uint32_t reserved;
+  uint8_t  salt[Snapshot::SaltLength];
+  uint8_t  iv[IVLength];
+  uint8_t  padding[4];
+  uint64_t count;  // number of entries
+  uint64_t length; // length of cipher text following the header, the tag follows the cipher text
+};
+// count and length are only known after all entries are sealed, so they are not associated data
+//  they are still verified on load: a snapshot loads only if count entries consume exactly length bytes
+constexpr size_t AuthenticatedHeaderLength = offsetof(SnapshotHeader, count);
+
+// each entry is sealed as its lengths followed by the key and the value
+struct EntryHeader {
+  uint16_t length[2];
+};
+
+auto read_header(const std::filesystem::path &path, SnapshotHeader &header) -> bool {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  auto length = read(fd, &header, sizeof(header));
+  close(fd);
+  return length == sizeof(header) && memcmp(header.magic, Magic, sizeof(Magic)) == 0;
+}
+
+auto write_all(int fd, const void *data, size_t length) -> bool {
+  const auto *pointer = reinterpret_cast<const uint8_t *>(data);
+  while (length != 0) {
+    auto written = write(fd, pointer, length);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    pointer += written;
+    length  -= written;
+  }
+  return true;
+}
+
+// fill data with random bytes from the kernel, retrying when interrupted
+auto fill_random(void *data, size_t length) -> bool {
+  auto  *pointer = reinterpret_cast<uint8_t *>(data);
+  size_t filled  = 0;
+  while (filled < length) {
+    const auto result = getrandom(pointer + filled, length - filled, 0);
+    if (result > 0) {
+      filled += result;
+    } else if (result == -1 && errno != EINTR) {
+      std::println(stderr, "failed to get random bytes: {}", strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+Snapshot::Snapshot(std::filesystem::path path, uint32_t iterations)
+  : path(std::move(path)), iterations(iterations) {}
+
+auto Snapshot::prepare() -> bool {
+  SnapshotHeader header;
+  if (read_header(this->path, header)) {
+    // keep using the parameters of the existing snapshot so it can be opened with the same secret
+    memcpy(this->salt, header.salt, sizeof(this->salt));
+    this->iterations = header.iterations;
+    return true;
+  }
+  return fill_random(this->salt, sizeof(this->salt));
+}
+
+auto Snapshot::derive(std::string_view secret) -> bool {
+  this->key.assign(KeyLength, '\0');
+  return PKCS5_PBKDF2_HMAC(
+           secret.data(),
+           static_cast<int>(secret.size()),
+           this->salt,
+           sizeof(this->salt),
+           static_cast<int>(this->iterations),
+           EVP_sha256(),
+           KeyLength,
+           reinterpret_cast<uint8_t *>(this->key.data())
+         ) == 1;
+}
+
+auto Snapshot::from_passphrase(std::filesystem::path path, std::string_view passphrase)
+  -> std::optional<Snapshot> {
+  Snapshot snapshot(std::move(path), PassphraseIterations);
+  if (!snapshot.prepare() || !snapshot.derive(passphrase)) {
+    return {};
+  }
+  return snapshot;
+}
+
+auto Snapshot::from_keyring(std::filesystem::path path, const char *description) -> std::optional<Snapshot> {
+  auto id = syscall(SYS_request_key, "user", description, nullptr, 0);
+  if (id == -1) {
+    std::println(stderr, "failed to find key {} in keyring: {}", description, strerror(errno));
+    return {};
+  }
+  auto length = syscall(SYS_keyctl, KEYCTL_READ, id, nullptr, 0);
+  if (length <= 0) {
+    std::println(stderr, "failed to read key {} from keyring: {}", description, strerror(errno));
+    return {};
+  }
+  secured_string secret(length, '\0');
+  if (syscall(SYS_keyctl, KEYCTL_READ, id, secret.data(), secret.size()) != length) {
+    std::println(stderr, "failed to read key {} from keyring: {}", description, strerror(errno));
+    return {};
+  }
+  Snapshot snapshot(std::move(path), KeyringIterations);
+  if (!snapshot.prepare() || !snapshot.derive({secret.data(), secret.size()})) {
+    return {};
+  }
+  return snapshot;
+}
+
+auto Snapshot::exists() const -> bool { return std::filesystem::exists(this->path); }
+
+auto Snapshot::load(Storage &storage) const -> bool {
+  int fd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    std::println(stderr, "failed to open {}: {}", this->path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) == -1 ||
+      static_cast<size_t>(status.st_size) < sizeof(SnapshotHeader) + TagLength) {
+    std::println(stderr, "{} is not a snapshot", this->path.c_str());
+    close(fd);
+    return false;
+  }
+  // the file holds only cipher text, it is mapped as is and decrypted straight into locked memory
+  const size_t size = status.st_size;
+  void *mapping     = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::println(stderr, "failed to map {}: {}", this->path.c_str(), strerror(errno));
+    return false;
+  }
+  const auto *base   = reinterpret_cast<const uint8_t *>(mapping);
+  const auto *header = reinterpret_cast<const SnapshotHeader *>(base);
+
+  bool  result  = false;
+  auto *context = EVP_CIPHER_CTX_new();
+  do {
+    if (memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+        header->length != size - sizeof(SnapshotHeader) - TagLength) {
+      std::println(stderr, "{} is not a snapshot", this->path.c_str());
+      break;
+    }
+    if (memcmp(header->salt, this->salt, sizeof(this->salt)) != 0 || header->iterations != this->iterations) {
+      std::println(stderr, "{} was changed since startup", this->path.c_str());
+      break;
+    }
+    int length = 0;
+    if (context == nullptr ||
+        EVP_DecryptInit_ex(context, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
+        EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_IVLEN, IVLength, nullptr) != 1 ||
+        EVP_DecryptInit_ex(
+          context, nullptr, nullptr, reinterpret_cast<const uint8_t *>(this->key.data()), header->iv
+        ) != 1 ||
+        EVP_DecryptUpdate(context, nullptr, &length, base, AuthenticatedHeaderLength) != 1) {
+      break;
+    }
+    const auto *input = base + sizeof(SnapshotHeader);
+    const auto *end   = input + header->length;
+    auto decrypt      = [&](void *output, size_t length) -> bool {
+      int written = 0;
+      if (static_cast<size_t>(end - input) < length) {
+        return false;
+      }
+      if (EVP_DecryptUpdate(
+            context, reinterpret_cast<uint8_t *>(output), &written, input, static_cast<int>(length)
+          ) != 1) {
+        return false;
+      }
+      input += length;
+      return static_cast<size_t>(written) == length;
+    };
+    // entries are decrypted into locked memory aside, and stored only once the tag verifies, so that nothing
+    //  forged or corrupted ever reaches the storage
+    SecretList entries;
+    uint64_t   count = 0;
+    for (; count < header->count; count++) {
+      EntryHeader entry;
+      if (!decrypt(&entry, sizeof(entry))) {
+        break;
+      }
+      secured_string key(entry.length[0], '\0');
+      secured_string value(entry.length[1], '\0');
+      if (!decrypt(key.data(), key.size()) || !decrypt(value.data(), value.size())) {
+        break;
+      }
+      entries.emplace_back(std::move(key), std::move(value));
+    }
+    if (count != header->count || input != end) {
+      std::println(stderr, "{} is truncated", this->path.c_str());
+      break;
+    }
+    uint8_t tag[TagLength];
+    memcpy(tag, end, TagLength);
+    if (EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_TAG, TagLength, tag) != 1 ||
+        EVP_DecryptFinal_ex(context, nullptr, &length) != 1) {
+      std::println(stderr, "{} failed authentication, wrong secret or corrupted", this->path.c_str());
+      break;
+    }
+    bool fits = true;
+    for (const auto &[key, value] : entries) {
+      // loaded secrets are pinned, as whether they were evictable is not kept in the snapshot
+      const auto stored = storage.update(key, value);
+      if (stored == Storage::Result::OverQuota || stored == Storage::Result::OutOfMemory) {
+        fits = false;
+        break;
+      }
+    }
+    if (!fits) {
+      std::println(stderr, "{} does not fit into the quotas or locked memory", this->path.c_str());
+      break;
+    }
+    result = true;
+  } while (false);
+  EVP_CIPHER_CTX_free(context);
+  munmap(mapping, size);
+  return result;
+}
+
+auto Snapshot::save(const Storage &storage) const -> bool {
+  auto temporary = this->path;
+  temporary     += ".tmp";
+  int fd         = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    std::println(stderr, "failed to create {}: {}", temporary.c_str(), strerror(errno));
+    return false;
+  }
+
+  SnapshotHeader header{};
+  memcpy(header.magic, Magic, sizeof(Magic));
+  memcpy(header.salt, this->salt, sizeof(this->salt));
+  header.iterations = this->iterations;
+  // a reused nonce would break GCM, so nothing is written without a fresh one
+  if (!fill_random(header.iv, sizeof(header.iv))) {
+    close(fd);
+    std::filesystem::remove(temporary);
+    return false;
+  }
+
+  // cipher text is buffered in ordinary memory and flushed in chunks
+  constexpr size_t     ChunkSize = 1 << 16;
+  std::vector<uint8_t> buffer;
+  buffer.reserve(ChunkSize + 4096);
+
+  bool  result  = false;
+  auto *context = EVP_CIPHER_CTX_new();
+  do {
+    int length = 0;
+    // the header is written once the count and length are known, reserve its space for now
+    if (!write_all(fd, &header, sizeof(header))) {
+      break;
+    }
+    if (context == nullptr ||
+        EVP_EncryptInit_ex(context, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
+        EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_IVLEN, IVLength, nullptr) != 1 ||
+        EVP_EncryptInit_ex(
+          context, nullptr, nullptr, reinterpret_cast<const uint8_t *>(this->key.data()), header.iv
+        ) != 1 ||
+        EVP_EncryptUpdate(
+          context, nullptr, &length, reinterpret_cast<const uint8_t *>(&header), AuthenticatedHeaderLength
+        ) != 1) {
+      break;
+    }
+    bool failed  = false;
+    auto encrypt = [&](const void *input, size_t length) {
+      if (failed || length == 0) {
+        return;
+      }
+      const auto offset  = buffer.size();
+      int        written = 0;
+      buffer.resize(offset + length);
+      if (EVP_EncryptUpdate(
+            context,
+            buffer.data() + offset,
+            &written,
+            reinterpret_cast<const uint8_t *>(input),
+            static_cast<int>(length)
+          ) != 1) {
+        failed = true;
+        return;
+      }
+      buffer.resize(offset + written);
+      header.length += written;
+      if (buffer.size() >= ChunkSize) {
+        failed = !write_all(fd, buffer.data(), buffer.size());
+        buffer.clear();
+      }
+    };
+    storage.for_each([&](const secured_string &key, const secured_string &value) {
+      EntryHeader entry{{static_cast<uint16_t>(key.size()), static_cast<uint16_t>(value.size())}};
+      encrypt(&entry, sizeof(entry));
+      encrypt(key.data(), key.size());
+      encrypt(value.data(), value.size());
+      header.count++;
+    });
+    if (failed) {
+      break;
+    }
+    buffer.resize(buffer.size() + EVP_MAX_BLOCK_LENGTH);
+    if (EVP_EncryptFinal_ex(context, buffer.data() + buffer.size() - EVP_MAX_BLOCK_LENGTH, &length) != 1) {
+      break;
+    }
+    buffer.resize(buffer.size() - EVP_MAX_BLOCK_LENGTH + length);
+    header.length += length;
+    uint8_t tag[TagLength];
+    if (EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_GET_TAG, TagLength, tag) != 1) {
+      break;
+    }
+    if (!write_all(fd, buffer.data(), buffer.size()) || !write_all(fd, tag, sizeof(tag))) {
+      break;
+    }
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || fsync(fd) == -1) {
+      break;
+    }
+    result = true;
+  } while (false);
+  EVP_CIPHER_CTX_free(context);
+  close(fd);
+
+  if (!result) {
+    std::println(stderr, "failed to write {}", temporary.c_str());
+    std::filesystem::remove(temporary);
+    return false;
+  }
+  if (rename(temporary.c_str(), this->path.c_str()) == -1) {
+    std::println(stderr, "failed to replace {}: {}", this->path.c_str(), strerror(errno));
+    std::filesystem::remove(temporary);
+    return false;
+  }
+  // make the rename itself durable
+  const auto parent    = this->path.has_parent_path() ? this->path.parent_path() : std::filesystem::path(".");
+  int        directory = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directory != -1) {
+    fsync(directory);
+    close(directory);
+  }
+  return true;
+}
@@ -0,0 +1,41 @@
+#ifndef SNAPSHOT_HH_
+#define SNAPSHOT_HH_
+#include "hardened_memory_allocator.hh"
+#include "storage.hh"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+// encrypted snapshot of a storage
+//  the snapshot is sealed with AES-256-GCM under a key derived from a passphrase or a kernel keyring entry,
+//   the header is authenticated together with the content so any corruption or tampering is detected
+//  a snapshot is always written to a temporary file first and then renamed over the target atomically
+class Snapshot final {
+public:
+  static constexpr size_t SaltLength = 16;
+
+  // derive the sealing key from a passphrase
+  static auto from_passphrase(std::filesystem::path path, std::string_view passphrase)
+    -> std::optional<Snapshot>;
+  // derive the sealing key from a user key in the kernel keyring of this process found by description
+  static auto from_keyring(std::filesystem::path path, const char *description) -> std::optional<Snapshot>;
+
+  [[nodiscard]] auto exists() const -> bool;
+  // load all entries of the snapshot into storage, return false if the snapshot is not intact
+  //  entries are decrypted straight into locked memory, no plain text copy is ever made elsewhere
+  auto load(Storage &storage) const -> bool;
+  auto save(const Storage &storage) const -> bool;
+
+private:
+  std::filesystem::path path;
+  secured_string        key;
+  uint8_t               salt[SaltLength];
+  uint32_t              iterations;
+
+  Snapshot(std::filesystem::path path, uint32_t iterations);
+  // take the salt and iterations of an existing snapshot, or make a fresh salt
+  auto prepare() -> bool;
+  auto derive(std::string_view secret) -> bool;
+};
+#endif
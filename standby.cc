@@ -0,0 +1,124 @@
+#include "standby.hh"
+#include "message.hh"
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+using SecuredStringSet = std::
+  unordered_set<secured_string, SecuredStringHash, std::equal_to<>, HardenedMemoryAllocator<secured_string>>;
+
+// connect to the socket at address and ask for replication, return the socket, or -1 if failed
+static auto request_replication(const sockaddr_un &address) -> int {
+  const int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_fd == -1) {
+    return -1;
+  }
+  uint8_t     buffer[sizeof(Message)];
+  auto *const request = reinterpret_cast<Message *>(buffer);
+  request->type       = Message::Type::Replicate;
+  request->flags      = 0;
+  if (connect(socket_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1
+      || send(socket_fd, buffer, sizeof(buffer), MSG_NOSIGNAL) != sizeof(buffer)) {
+    close(socket_fd);
+    return -1;
+  }
+  return socket_fd;
+}
+
+auto Standby::connect(const sockaddr_un &address, size_t reactors) -> std::unique_ptr<Standby> {
+  const int socket_fd = request_replication(address);
+  if (socket_fd == -1) {
+    return nullptr;
+  }
+  // a primary refusing replies Failed right away, while one accepting starts with a secret or Ok, which is
+  //  left to follow
+  Message reply{};
+  if (!peek_header(socket_fd, &reply) || reply.type == Message::Type::Failed) {
+    close(socket_fd);
+    return nullptr;
+  }
+  return std::unique_ptr<Standby>(new Standby(address, reactors, socket_fd));
+}
+
+Standby::~Standby() {
+  if (this->socket_fd != -1) {
+    close(this->socket_fd);
+  }
+}
+
+auto Standby::follow(Storage &storage) -> bool {
+  HardenedMemoryAllocator<uint8_t> allocator;
+  auto *const buffer   = reinterpret_cast<Message *>(allocator.allocate(MessageBufferSize));
+  bool        complete = false;
+  while (this->socket_fd != -1) {
+    // keys received before the Ok message, any other one held is stale once it arrives
+    SecuredStringSet received;
+    bool             copied = false;
+    MessageReceiver  receiver(this->socket_fd, buffer);
+    while (receiver.receive()) {
+      const auto *const message = receiver.message();
+      if (message->type == Message::Type::Add) {
+        const auto *const body = reinterpret_cast<const DoubleEntryBody *>(message->data);
+        const auto *const      data = reinterpret_cast<const char *>(body->data);
+        const std::string_view key(data, body->length[0]);
+        const std::string_view value(data + key.size(), body->length[1]);
+        // a secret that does not fit into the quotas or locked memory of the standby is left out, as it
+        //  would be by the primary with the same limits
+        storage.update(key, value, (message->flags & Message::Flags::Add_Evictable) != 0);
+        if (!copied) {
+          received.emplace(key);
+        }
+      } else if (message->type == Message::Type::Delete) {
+        const auto *const body = reinterpret_cast<const SingleEntryBody *>(message->data);
+        storage.remove({reinterpret_cast<const char *>(body->data), body->length});
+      } else if (message->type == Message::Type::Ok && !copied) {
+        // removed afterwards, as the storage is locked while listing
+        std::vector<secured_string, HardenedMemoryAllocator<secured_string>> stale;
+        storage.list_prefix("", [&](std::string_view key) {
+          if (!received.contains(key)) {
+            stale.emplace_back(key);
+          }
+        });
+        for (const auto &key : stale) {
+          storage.remove(key);
+        }
+        SecuredStringSet().swap(received);
+        copied   = true;
+        complete = true;
+      } else {
+        break;
+      }
+    }
+    close(this->socket_fd);
+    if (!copied) {
+      std::this_thread::sleep_for(RetryInterval);
+    }
+    // a primary that is gone refuses the connection, or its socket is removed already
+    this->socket_fd = request_replication(this->address);
+  }
+  allocator.deallocate(reinterpret_cast<uint8_t *>(buffer), MessageBufferSize);
+  if (!complete) {
+    return false;
+  }
+  // a socket still taking connections belongs to a server running, and is left for starting to fail on
+  for (size_t i = 0; i < this->reactors; i++) {
+    const auto address = reactor_address(this->address, i);
+    if (!address.has_value()) {
+      continue;
+    }
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe == -1) {
+      continue;
+    }
+    if (::connect(probe, reinterpret_cast<const sockaddr *>(&address.value()), sizeof(address.value())) == -1
+        && errno == ECONNREFUSED) {
+      unlink(address->sun_path);
+    }
+    close(probe);
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef STANDBY_HH_
+#define STANDBY_HH_
+#include "storage.hh"
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <sys/un.h>
+
+// a hot standby mirroring the storage of a primary server on the same host into locked memory of its own, so
+//  that it takes over the sockets of the primary as soon as it is gone, and clients are served again within
+//  milliseconds instead of once someone seeds a new server
+//  the primary is asked to Replicate over its first socket, see message.hh, and sends every secret it holds,
+//   followed by every change as it is made
+//  the primary is taken as gone once the connection is closed and its socket refuses a new one, as it does
+//   once the primary crashed or shut down, while a standby dropped by a primary still running, e.g. as it
+//   lagged behind, connects again and receives every secret once more
+class Standby final {
+public:
+  // wait this long before connecting again once a connection is closed before every secret was received,
+  //  e.g. as the primary refused it, so that a standby never spins
+  static constexpr auto RetryInterval = std::chrono::milliseconds(100);
+
+  // connect to the primary listening at address with reactors, and ask it to replicate, nullptr if failed or
+  //  refused, e.g. as the policy of the primary does not grant the admin permission to this process
+  static auto connect(const sockaddr_un &address, size_t reactors) -> std::unique_ptr<Standby>;
+  Standby(const Standby &)                     = delete;
+  Standby(Standby &&)                          = delete;
+  auto operator=(const Standby &) -> Standby & = delete;
+  auto operator=(Standby &&) -> Standby      & = delete;
+  ~Standby();
+
+  // mirror the storage of the primary into storage until it is gone, replacing whatever storage held
+  //  return true once it is gone, with the sockets it left behind removed so that a server may listen on
+  //   them, or false if it is gone before every secret it held was received once
+  auto follow(Storage &storage) -> bool;
+
+private:
+  sockaddr_un address;
+  size_t      reactors;
+  int         socket_fd;
+
+  Standby(const sockaddr_un &address, size_t reactors, int socket_fd)
+    : address(address), reactors(reactors), socket_fd(socket_fd) {}
+};
+#endif
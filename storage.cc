@@ -1,56 +1,763 @@
 #include "storage.hh"
+#include "cold_tier.hh"
+#include "incremental_hash_map.hh"
+#include "message.hh"
+#include "trace.hh"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <optional>
+#include <set>
 #include <string>
 #include <unistd.h>
 #include <unordered_map>
+#include <vector>
+
+// orders pointers to keys stored in the map by the keys they point to
+struct KeyOrder {
+  using is_transparent = void;
+
+  static inline auto view(const secured_string *key) -> std::string_view { return {key->data(), key->size()}; }
+  static inline auto view(std::string_view key) -> std::string_view { return key; }
+
+  auto operator()(const auto &lhs, const auto &rhs) const -> bool { return view(lhs) < view(rhs); }
+};
+
+struct Secret;
+
+// links of a secret in a ring of its partition
+struct Links {
+  Secret *previous{nullptr};
+  Secret *next{nullptr};
+};
+
+// a value along with what evicting and sealing it takes
+struct Secret {
+  // the value while the secret is hot, empty while it is sealed into the cold tier
+  secured_string        value;
+  ColdTier::Sealed      sealed;
+  // the key of the entry holding it, as an entry evicted or sealed is found by the secret
+  const secured_string *key{nullptr};
+  // evictable secrets are linked into a ring of their partition, pinned ones never are
+  bool                  evictable;
+  bool                  hot{true};
+  // set whenever the secret is looked up, and cleared as the hand of the ring of evictable secrets passes it
+  mutable bool          referenced{false};
+  // likewise for the ring of hot secrets to be sealed
+  mutable bool          read{false};
+  Links                 evictables;
+  Links                 residents;
+
+  Secret(std::string_view value, bool evictable) : value(value), evictable(evictable) {}
+  Secret(ColdTier::Sealed sealed, bool evictable) : sealed(sealed), evictable(evictable), hot(false) {}
+
+  [[nodiscard]] auto size() const -> size_t { return this->hot ? this->value.size() : this->sealed.length; }
+};
+
+// secrets of a partition swept by a hand, which picks the first secret not marked since the hand last passed
+//  it, so that recently used secrets get a second chance and are picked last
+//  a ring is only ever changed with its partition locked
+template <Links Secret::*Member, bool Secret::*Mark> class Ring {
+public:
+  [[nodiscard]] auto size() const -> size_t { return this->count; }
+
+  void link(Secret &secret) {
+    auto &links = secret.*Member;
+    if (this->hand == nullptr) {
+      links.previous = &secret;
+      links.next     = &secret;
+      this->hand     = &secret;
+    } else {
+      // right behind the hand, so that it is passed last
+      links.previous                 = (this->hand->*Member).previous;
+      links.next                     = this->hand;
+      (links.previous->*Member).next = &secret;
+      (this->hand->*Member).previous = &secret;
+    }
+    this->count++;
+  }
+  void unlink(Secret &secret) {
+    auto &links = secret.*Member;
+    if (links.next == &secret) {
+      this->hand = nullptr;
+    } else {
+      (links.previous->*Member).next = links.next;
+      (links.next->*Member).previous = links.previous;
+      if (this->hand == &secret) {
+        this->hand = links.next;
+      }
+    }
+    this->count--;
+  }
+  // sweep for a secret matches holds for, nullptr if there is none
+  template <typename Predicate> auto sweep(Predicate &&matches) -> Secret * {
+    // every secret passed once has its mark cleared, so a second round finds one unless none matches
+    for (size_t i = 0; this->hand != nullptr && i < 2 * this->count; i++) {
+      auto *const secret = this->hand;
+      this->hand         = (secret->*Member).next;
+      if (!matches(*secret)) {
+        continue;
+      }
+      if (secret->*Mark) {
+        secret->*Mark = false;
+        continue;
+      }
+      return secret;
+    }
+    return nullptr;
+  }
 
-class StorageImplementation {
 private:
-  secured_unordered_map map;
-  mutable std::mutex    mutex;
+  Secret *hand{nullptr};
+  size_t  count{0};
+};
+
+// grows incrementally, so that no request stalls on rehashing every secret while the storage is locked
+using SecretMap = IncrementalHashMap<
+  secured_string,
+  Secret,
+  SecuredStringHash,
+  std::equal_to<>,
+  HardenedMemoryAllocator<std::pair<const secured_string, Secret>>>;
+
+using Evicted = std::function<void(std::string_view)>;
 
+// bytes charged for a secret, the overhead roughly covers its node in the map, its node in the index and the
+//  headers of the blocks holding them
+static constexpr size_t EntryOverhead = 128;
+static inline auto      cost(std::string_view key, size_t value) -> size_t {
+  return key.size() + value + EntryOverhead;
+}
+
+// the part of a key up to and including its first '/', which is empty if there is none
+static inline auto namespace_of(std::string_view key) -> std::string_view {
+  return key.substr(0, key.find('/') + 1);
+}
+
+// bytes held by secrets against the quotas on them, shared by all partitions
+class Usage {
 public:
-  auto add(const secured_string &&key, const secured_string &&value) -> bool {
+  size_t global_quota{0};
+  size_t namespace_quota{0};
+
+  // whether a secret of bytes may fit into the quotas at all
+  [[nodiscard]] auto admissible(size_t bytes) const -> bool {
+    return (this->global_quota == 0 || bytes <= this->global_quota)
+           && (this->namespace_quota == 0 || bytes <= this->namespace_quota);
+  }
+  // charge bytes for a secret of key, return nothing if they fit, or otherwise the prefix of keys to evict to
+  //  make room for them without charging anything, which is empty if it is the global quota that is exceeded
+  //  may throw std::bad_alloc when a namespace is charged for the first time
+  auto charge(std::string_view key, size_t bytes) -> std::optional<std::string_view> {
+    if (bytes == 0) {
+      return {};
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->global_quota != 0 && this->used + bytes > this->global_quota) {
+      return std::string_view();
+    }
+    if (this->namespace_quota != 0) {
+      const auto name     = namespace_of(key);
+      auto       iterator = this->namespaces.find(name);
+      if (iterator == this->namespaces.end()) {
+        iterator = this->namespaces.emplace(secured_string(name), 0).first;
+      }
+      if (iterator->second + bytes > this->namespace_quota) {
+        return name;
+      }
+      iterator->second += bytes;
+    }
+    this->used += bytes;
+    return {};
+  }
+  void release(std::string_view key, size_t bytes) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->used -= bytes;
+    if (this->namespace_quota != 0) {
+      const auto iterator = this->namespaces.find(namespace_of(key));
+      if (iterator != this->namespaces.end() && (iterator->second -= bytes) == 0) {
+        this->namespaces.erase(iterator);
+      }
+    }
+  }
+
+private:
+  std::mutex mutex;
+  size_t     used{0};
+  // names are parts of keys, so they are kept in locked memory like keys
+  std::unordered_map<
+    secured_string,
+    size_t,
+    SecuredStringHash,
+    std::equal_to<>,
+    HardenedMemoryAllocator<std::pair<const secured_string, size_t>>>
+    namespaces;
+};
+
+// a share of the secrets with a lock of its own
+//  a key always belongs to the partition partition_of picks by its digest
+//  evictable secrets are kept in a ring, which is swept for the least recently used one to evict
+//  with a cold tier, values are sealed into it as they are stored, and unsealed into locked memory as they
+//   are read, while hot values are kept in another ring swept for the least recently read one to seal again
+//   once they take more than the limit
+struct Partition {
+  SecretMap map;
+  // ordered index over keys in the map to support prefix scans
+  //  entries of the map never move, so pointers to keys stay valid until they are erased
+  std::set<const secured_string *, KeyOrder, HardenedMemoryAllocator<const secured_string *>> index;
+  mutable std::mutex                                                                          mutex;
+  Ring<&Secret::evictables, &Secret::referenced>                                              evictables;
+  Ring<&Secret::residents, &Secret::read>                                                     residents;
+  // nullptr unless values are sealed
+  std::unique_ptr<ColdTier>                                                                   cold;
+  size_t                                                                                      hot_limit{0};
+  size_t                                                                                      hot_bytes{0};
+  // cold values are unsealed into it when they are not promoted, it is reserved for the largest value that is
+  //  ever sealed, so that it never reallocates
+  mutable secured_string                                                                      scratch;
+  Usage                                                                                      &usage;
+  const Storage::Journal                                                                     &journal;
+
+  Partition(Usage &usage, const Storage::Journal &journal) : usage(usage), journal(journal) {}
+
+  // whether a secret is hot and may be sealed, which are the secrets linked into the ring of hot ones
+  [[nodiscard]] auto resident(const Secret &secret) const -> bool {
+    return this->cold != nullptr && secret.hot && secret.value.size() <= this->scratch.capacity();
+  }
+
+  // store a secret with the partition locked, into entry if it is the existing one of key, return the entry
+  //  nothing is changed if memory runs out
+  auto put(
+    std::string_view       key,
+    std::string_view       value,
+    size_t                 digest,
+    bool                   evictable,
+    SecretMap::value_type *entry
+  ) -> SecretMap::value_type * {
+    // values too large to be unsealed into the scratch buffer stay hot
+    std::optional<ColdTier::Sealed> sealed;
+    if (this->cold != nullptr && value.size() <= this->scratch.capacity()) {
+      sealed = this->cold->seal(key, value);
+    }
+    if (entry != nullptr) {
+      auto &secret = entry->second;
+      if (sealed.has_value()) {
+        this->forget(secret);
+        // freeing a hot value wipes it
+        secured_string().swap(secret.value);
+        secret.sealed = sealed.value();
+        secret.hot    = false;
+      } else {
+        const bool resident = this->resident(secret);
+        const auto previous = secret.value.size();
+        secret.value.assign(value);
+        if (!secret.hot) {
+          this->cold->release(secret.sealed);
+          secret.hot = true;
+        } else if (resident) {
+          this->residents.unlink(secret);
+          this->hot_bytes -= previous;
+        }
+        this->settle(secret);
+      }
+      secret.evictable = evictable;
+    } else {
+      try {
+        entry = sealed.has_value()
+                ? this->map.try_emplace(key, Secret(sealed.value(), evictable), digest).first
+                : this->map.try_emplace(key, Secret(value, evictable), digest).first;
+        try {
+          this->index.insert(&entry->first);
+        } catch (const std::bad_alloc &) {
+          this->map.erase(key, digest);
+          throw;
+        }
+      } catch (const std::bad_alloc &) {
+        if (sealed.has_value()) {
+          this->cold->release(sealed.value());
+        }
+        throw;
+      }
+      entry->second.key = &entry->first;
+      this->settle(entry->second);
+    }
+    if (evictable) {
+      this->evictables.link(entry->second);
+    }
+    return entry;
+  }
+  // link a secret made hot into the ring of hot ones, if it may be sealed
+  void settle(Secret &secret) {
+    if (this->resident(secret)) {
+      this->residents.link(secret);
+      this->hot_bytes += secret.value.size();
+    }
+  }
+  // drop the sealed value of a cold secret, or unlink a hot one from the ring of hot ones
+  void forget(Secret &secret) {
+    if (!secret.hot) {
+      this->cold->release(secret.sealed);
+    } else if (this->resident(secret)) {
+      this->residents.unlink(secret);
+      this->hot_bytes -= secret.value.size();
+    }
+  }
+  // unseal the value of a cold secret into locked memory, return false if failed
+  auto promote(Secret &secret) -> bool {
+    const auto key = KeyOrder::view(secret.key);
+    try {
+      secret.value.resize(secret.sealed.length);
+    } catch (const std::bad_alloc &) {
+      return false;
+    }
+    if (!this->cold->unseal(key, secret.sealed, secret.value.data())) {
+      secured_string().swap(secret.value);
+      return false;
+    }
+    this->cold->release(secret.sealed);
+    secret.hot = true;
+    this->settle(secret);
+    return true;
+  }
+  // seal hot values again as long as they take more than the limit, the least recently read first
+  void trim() {
+    while (this->hot_bytes > this->hot_limit) {
+      auto *const secret = this->residents.sweep([](const Secret &) { return true; });
+      if (secret == nullptr || !this->demote(*secret)) {
+        break;
+      }
+    }
+  }
+  // seal the value of a hot secret and wipe it from locked memory, return false if failed
+  auto demote(Secret &secret) -> bool {
+    std::optional<ColdTier::Sealed> sealed;
+    try {
+      sealed = this->cold->seal(KeyOrder::view(secret.key), secret.value);
+    } catch (const std::bad_alloc &) {
+    }
+    if (!sealed.has_value()) {
+      return false;
+    }
+    this->forget(secret);
+    secured_string().swap(secret.value);
+    secret.sealed = sealed.value();
+    secret.hot    = false;
+    return true;
+  }
+  // pass the value of a secret to callback, unsealing it into the scratch buffer if it is cold, return false
+  //  if it fails to authenticate
+  template <typename Callback> auto reveal(const Secret &secret, Callback &&callback) const -> bool {
+    if (secret.hot) {
+      callback(secret.value);
+      return true;
+    }
+    this->scratch.resize(secret.sealed.length);
+    if (!this->cold->unseal(KeyOrder::view(secret.key), secret.sealed, this->scratch.data())) {
+      return false;
+    }
+    callback(this->scratch);
+    explicit_bzero(this->scratch.data(), this->scratch.size());
+    return true;
+  }
+
+  // stop accounting for the secret of an entry about to be erased
+  void detach(SecretMap::value_type &entry) {
+    const auto key = KeyOrder::view(&entry.first);
+    this->usage.release(key, cost(key, entry.second.size()));
+    if (entry.second.evictable) {
+      this->evictables.unlink(entry.second);
+    }
+    this->forget(entry.second);
+  }
+  // erase the secret of key with the partition locked, return the number of secrets erased
+  auto erase(std::string_view key, size_t digest) -> size_t {
+    // detach from the index first as the pointer dangles once the entry is erased from the map
+    const auto position = this->index.find(key);
+    if (position == this->index.end()) {
+      return 0;
+    }
+    this->index.erase(position);
+    this->detach(*this->map.find(key, digest));
+    if (this->journal) {
+      this->journal(key, {}, false);
+    }
+    return this->map.erase(key, digest);
+  }
+  // evict the least recently used evictable secret with a key starting with prefix, with the partition
+  //  locked, return false if there is none
+  auto evict(std::string_view prefix, const Evicted &evicted) -> bool {
+    auto *const secret = this->evictables.sweep([&](const Secret &candidate) {
+      return KeyOrder::view(candidate.key).starts_with(prefix);
+    });
+    if (secret == nullptr) {
+      return false;
+    }
+    const auto key = KeyOrder::view(secret->key);
+    if (evicted) {
+      evicted(key);
+    }
+    this->erase(key, SecuredStringHash{}(key));
+    return true;
+  }
+
+  [[nodiscard]] auto contains(std::string_view key, size_t digest) const -> bool {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->map.find(key, digest) != nullptr;
+  }
+  auto query(std::string_view key, size_t digest, const std::function<void(std::string_view)> &found)
+    -> bool {
     std::lock_guard<std::mutex> lock(this->mutex);
-    return this->map.insert(std::make_pair(key, value)).second;
+    auto *const                 entry = this->map.find(key, digest);
+    if (entry == nullptr) {
+      return false;
+    }
+    auto &secret      = entry->second;
+    secret.referenced = true;
+    secret.read       = true;
+    if (secret.hot) {
+      found(secret.value);
+      return true;
+    }
+    // a value that cannot be promoted for lack of locked memory, or that would be sealed again right away as
+    //  it alone exceeds the limit, is unsealed just for now
+    if (secret.sealed.length > this->hot_limit || !this->promote(secret)) {
+      return this->reveal(secret, found);
+    }
+    // found is done with the value before it may be sealed again
+    found(secret.value);
+    this->trim();
+    return true;
   }
-  void update(const secured_string &&key, const secured_string &&value) {
+  auto remove(std::string_view key, size_t digest) -> size_t {
     std::lock_guard<std::mutex> lock(this->mutex);
-    this->map.insert_or_assign(key, value);
+    return this->erase(key, digest);
   }
-  [[nodiscard]] auto query(const secured_string &&key) const -> const secured_string * {
+  auto take(std::string_view key, size_t digest, const std::function<void(std::string_view)> &found)
+    -> bool {
     std::lock_guard<std::mutex> lock(this->mutex);
-    const auto                  iterator = this->map.find(key);
-    if (iterator == this->map.cend()) {
-      return nullptr;
+    auto *const                 entry = this->map.find(key, digest);
+    if (entry == nullptr || !this->reveal(entry->second, found)) {
+      return false;
     }
-    return &iterator->second;
+    this->erase(key, digest);
+    return true;
   }
-  auto remove(const secured_string &&key) -> size_t {
+  [[nodiscard]] auto size() const -> size_t {
     std::lock_guard<std::mutex> lock(this->mutex);
-    return this->map.erase(key);
+    return this->map.size();
+  }
+  auto remove_prefix(std::string_view prefix, const std::function<void(std::string_view)> &removed)
+    -> size_t {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t                      count    = 0;
+    auto                        iterator = this->index.lower_bound(prefix);
+    while (iterator != this->index.end() && KeyOrder::view(*iterator).starts_with(prefix)) {
+      const auto key    = KeyOrder::view(*iterator);
+      const auto digest = SecuredStringHash{}(key);
+      if (removed) {
+        removed(key);
+      }
+      // detach from the index first as the pointer dangles once the element is erased from the map
+      iterator = this->index.erase(iterator);
+      this->detach(*this->map.find(key, digest));
+      if (this->journal) {
+        this->journal(key, {}, false);
+      }
+      this->map.erase(key, digest);
+      count++;
+    }
+    return count;
+  }
+  void for_each(const std::function<void(const secured_string &, const secured_string &)> &callback) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->map.for_each([&](const SecretMap::value_type &entry) {
+      this->reveal(entry.second, [&](const secured_string &value) { callback(entry.first, value); });
+    });
+  }
+  // return whether take stopped before the last secret, with cursor left at the last secret taken
+  auto replay(Storage::Cursor &cursor, const Storage::Replay &take) const -> bool {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto iterator =
+      cursor.started ? this->index.upper_bound(std::string_view(cursor.after)) : this->index.begin();
+    for (; iterator != this->index.end(); ++iterator) {
+      const auto        key   = KeyOrder::view(*iterator);
+      const auto *const entry = this->map.find(key, SecuredStringHash{}(key));
+      // a secret failing to authenticate is passed over, as it is by for_each
+      bool taken = true;
+      this->reveal(entry->second, [&](std::string_view value) {
+        taken = take(key, value, entry->second.evictable);
+      });
+      if (!taken) {
+        return true;
+      }
+      cursor.after.assign(key);
+      cursor.started = true;
+    }
+    return false;
+  }
+};
+
+class StorageImplementation {
+private:
+  Usage                                   usage;
+  Storage::Journal                        journal;
+  // partitions never move, as each of them holds a mutex
+  std::vector<std::unique_ptr<Partition>> partitions;
+
+  [[nodiscard]] auto partition(size_t digest) const -> Partition & {
+    return *this->partitions[partition_of(digest, this->partitions.size())];
+  }
+
+  // evict a secret with a key starting with prefix from the partition the caller has locked, or otherwise
+  //  from any other one not locked at the moment, as waiting for its lock could deadlock with a caller
+  //  holding it and waiting for the lock of the former
+  auto evict(Partition &locked, std::string_view prefix, const Evicted &evicted) -> bool {
+    if (locked.evict(prefix, evicted)) {
+      return true;
+    }
+    for (const auto &partition : this->partitions) {
+      if (partition.get() == &locked) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(partition->mutex, std::try_to_lock);
+      if (lock.owns_lock() && partition->evict(prefix, evicted)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto store(
+    std::string_view key, std::string_view value, bool evictable, bool replace, const Evicted &evicted
+  ) -> Storage::Result {
+    const auto                  digest    = SecuredStringHash{}(key);
+    auto                       &partition = this->partition(digest);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    auto *const                 entry = partition.map.find(key, digest);
+    if (entry != nullptr && !replace) {
+      return Storage::Result::Exists;
+    }
+    const auto required = cost(key, value.size());
+    const auto previous = entry == nullptr ? 0 : cost(key, entry->second.size());
+    const auto growth   = required > previous ? required - previous : 0;
+    if (!this->usage.admissible(required)) {
+      return Storage::Result::OverQuota;
+    }
+    // the secret replaced is taken out of the ring meanwhile, so that it is never evicted to make room for
+    //  its own value
+    if (entry != nullptr && entry->second.evictable) {
+      partition.evictables.unlink(entry->second);
+    }
+    while (true) {
+      std::optional<std::string_view> exceeded;
+      try {
+        exceeded = this->usage.charge(key, growth);
+        if (!exceeded.has_value()) {
+          try {
+            partition.put(key, value, digest, evictable, entry);
+          } catch (const std::bad_alloc &) {
+            this->usage.release(key, growth);
+            throw;
+          }
+          if (this->journal) {
+            this->journal(key, value, evictable);
+          }
+          if (previous > required) {
+            this->usage.release(key, previous - required);
+          }
+          return entry == nullptr ? Storage::Result::Added : Storage::Result::Replaced;
+        }
+      } catch (const std::bad_alloc &) {
+        // any secret evicted returns memory to the allocator, whatever namespace it is in
+        exceeded.reset();
+      }
+      if (!this->evict(partition, exceeded.value_or(std::string_view()), evicted)) {
+        if (entry != nullptr && entry->second.evictable) {
+          partition.evictables.link(entry->second);
+        }
+        return exceeded.has_value() ? Storage::Result::OverQuota : Storage::Result::OutOfMemory;
+      }
+    }
+  }
+
+public:
+  StorageImplementation(size_t partitions) {
+    for (size_t i = 0; i < std::max<size_t>(partitions, 1); i++) {
+      this->partitions.push_back(std::make_unique<Partition>(this->usage, this->journal));
+    }
+  }
+
+  void set_quotas(size_t global, size_t per_namespace) {
+    this->usage.global_quota    = global;
+    this->usage.namespace_quota = per_namespace;
+  }
+  auto enable_cold_tier(size_t hot_bytes) -> bool {
+    for (const auto &partition : this->partitions) {
+      partition->cold = ColdTier::create();
+      if (partition->cold == nullptr) {
+        return false;
+      }
+      // the limit is split evenly, so that each partition keeps to its share with its own lock only
+      partition->hot_limit = hot_bytes / this->partitions.size();
+      partition->scratch.reserve(MessageBufferSize);
+    }
+    return true;
+  }
+
+  auto add(std::string_view key, std::string_view value, bool evictable, const Evicted &evicted)
+    -> Storage::Result {
+    TRACE_SCOPE("storage.add", key.size() + value.size());
+    return this->store(key, value, evictable, false, evicted);
+  }
+  auto update(std::string_view key, std::string_view value, bool evictable, const Evicted &evicted)
+    -> Storage::Result {
+    TRACE_SCOPE("storage.update", key.size() + value.size());
+    return this->store(key, value, evictable, true, evicted);
+  }
+  [[nodiscard]] auto contains(std::string_view key) const -> bool {
+    TRACE_SCOPE("storage.contains", key.size());
+    const auto digest = SecuredStringHash{}(key);
+    return this->partition(digest).contains(key, digest);
+  }
+  auto query(std::string_view key, const std::function<void(std::string_view)> &found) -> bool {
+    TRACE_SCOPE("storage.query", key.size());
+    const auto digest = SecuredStringHash{}(key);
+    return this->partition(digest).query(key, digest, found);
+  }
+  auto remove(std::string_view key) -> size_t {
+    TRACE_SCOPE("storage.remove", key.size());
+    const auto digest = SecuredStringHash{}(key);
+    return this->partition(digest).remove(key, digest);
+  }
+  auto take(std::string_view key, const std::function<void(std::string_view)> &found) -> bool {
+    TRACE_SCOPE("storage.take", key.size());
+    const auto digest = SecuredStringHash{}(key);
+    return this->partition(digest).take(key, digest, found);
+  }
+  [[nodiscard]] auto size() const -> size_t {
+    size_t result = 0;
+    for (const auto &partition : this->partitions) {
+      result += partition->size();
+    }
+    return result;
+  }
+  void list_prefix(std::string_view prefix, const std::function<void(std::string_view)> &callback) const {
+    TRACE_SCOPE("storage.list_prefix", prefix.size());
+    // every partition is locked, always in the same order, and their indexes are merged so that keys are
+    //  listed in order as of a single point in time
+    using Iterator = decltype(Partition::index)::const_iterator;
+    std::vector<std::unique_lock<std::mutex>>  locks;
+    std::vector<std::pair<Iterator, Iterator>> ranges;
+    for (const auto &partition : this->partitions) {
+      locks.emplace_back(partition->mutex);
+      ranges.emplace_back(partition->index.lower_bound(prefix), partition->index.end());
+    }
+    while (true) {
+      std::pair<Iterator, Iterator> *next = nullptr;
+      for (auto &range : ranges) {
+        if (range.first == range.second || !KeyOrder::view(*range.first).starts_with(prefix)) {
+          continue;
+        }
+        if (next == nullptr || KeyOrder()(*range.first, *next->first)) {
+          next = &range;
+        }
+      }
+      if (next == nullptr) {
+        break;
+      }
+      callback(KeyOrder::view(*next->first));
+      next->first++;
+    }
+  }
+  auto remove_prefix(std::string_view prefix, const std::function<void(std::string_view)> &removed)
+    -> size_t {
+    TRACE_SCOPE("storage.remove_prefix", prefix.size());
+    size_t count = 0;
+    for (const auto &partition : this->partitions) {
+      count += partition->remove_prefix(prefix, removed);
+    }
+    return count;
+  }
+  void for_each(const std::function<void(const secured_string &, const secured_string &)> &callback) const {
+    for (const auto &partition : this->partitions) {
+      partition->for_each(callback);
+    }
+  }
+  void set_journal(Storage::Journal journal) { this->journal = std::move(journal); }
+  auto replay(Storage::Cursor &cursor, const Storage::Replay &take) const -> bool {
+    for (; cursor.partition < this->partitions.size(); cursor.partition++) {
+      if (this->partitions[cursor.partition]->replay(cursor, take)) {
+        return true;
+      }
+      cursor.after.clear();
+      cursor.started = false;
+    }
+    return false;
   }
 };
 
-Storage::Storage() { this->implementation = new StorageImplementation(); }
+Storage::Storage(size_t partitions) { this->implementation = new StorageImplementation(partitions); }
 Storage::~Storage() { delete reinterpret_cast<StorageImplementation *>(this->implementation); }
-auto Storage::add(const secured_string &&key, const secured_string &&value) -> bool {
-  return reinterpret_cast<StorageImplementation *>(this->implementation)
-    ->add(std::forward<const secured_string>(key), std::forward<const secured_string>(value));
+void Storage::set_quotas(size_t global, size_t per_namespace) {
+  reinterpret_cast<StorageImplementation *>(this->implementation)->set_quotas(global, per_namespace);
 }
-void Storage::update(const secured_string &&key, const secured_string &&value) {
-  return reinterpret_cast<StorageImplementation *>(this->implementation)
-    ->update(std::forward<const secured_string>(key), std::forward<const secured_string>(value));
+auto Storage::enable_cold_tier(size_t hot_bytes) -> bool {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->enable_cold_tier(hot_bytes);
 }
-[[nodiscard]] auto Storage::query(const secured_string &&key) const -> const secured_string * {
-  return reinterpret_cast<StorageImplementation *>(this->implementation)
-    ->query(std::forward<const secured_string>(key));
+auto Storage::add(
+  std::string_view                             key,
+  std::string_view                             value,
+  bool                                         evictable,
+  const std::function<void(std::string_view)> &evicted
+) -> Result {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->add(key, value, evictable, evicted);
 }
-auto Storage::remove(const secured_string &&key) -> size_t {
+auto Storage::update(
+  std::string_view                             key,
+  std::string_view                             value,
+  bool                                         evictable,
+  const std::function<void(std::string_view)> &evicted
+) -> Result {
   return reinterpret_cast<StorageImplementation *>(this->implementation)
-    ->remove(std::forward<const secured_string>(key));
+    ->update(key, value, evictable, evicted);
+}
+[[nodiscard]] auto Storage::contains(std::string_view key) const -> bool {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->contains(key);
+}
+auto Storage::query(std::string_view key, const std::function<void(std::string_view)> &found) -> bool {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->query(key, found);
+}
+auto Storage::remove(std::string_view key) -> size_t {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->remove(key);
+}
+auto Storage::take(std::string_view key, const std::function<void(std::string_view)> &found) -> bool {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->take(key, found);
+}
+
+auto Storage::size() const -> size_t {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->size();
+}
+void Storage::list_prefix(std::string_view prefix, const std::function<void(std::string_view)> &callback)
+  const {
+  reinterpret_cast<StorageImplementation *>(this->implementation)->list_prefix(prefix, callback);
+}
+auto Storage::remove_prefix(std::string_view prefix, const std::function<void(std::string_view)> &removed)
+  -> size_t {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->remove_prefix(prefix, removed);
+}
+void Storage::for_each(
+  const std::function<void(const secured_string &, const secured_string &)> &callback
+) const {
+  reinterpret_cast<StorageImplementation *>(this->implementation)->for_each(callback);
+}
+void Storage::set_journal(Journal journal) {
+  reinterpret_cast<StorageImplementation *>(this->implementation)->set_journal(std::move(journal));
+}
+auto Storage::replay(Cursor &cursor, const Replay &take) const -> bool {
+  return reinterpret_cast<StorageImplementation *>(this->implementation)->replay(cursor, take);
 }
 
 __attribute__((weak)) auto main() -> int {
@@ -1,22 +1,106 @@
 #ifndef STORAGE_HH_
 #define STORAGE_HH_
 #include "hardened_memory_allocator.hh"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
 
 class Storage final {
 private:
   void *implementation;
 
 public:
-  Storage();
+  // secrets are split into partitions by the digests of their keys, each of them locked on its own, so that
+  //  requests on keys of different partitions never contend
+  //  lookups of single keys touch one partition, while prefix operations visit all of them
+  explicit Storage(size_t partitions = 1);
   Storage(const Storage &)                     = delete;
   Storage(Storage &&)                          = delete;
   auto operator=(const Storage &) -> Storage & = delete;
   auto operator=(Storage &&) -> Storage      & = delete;
   ~Storage();
 
-  auto               add(const secured_string &&key, const secured_string &&value) -> bool;
-  void               update(const secured_string &&key, const secured_string &&value);
-  [[nodiscard]] auto query(const secured_string &&key) const -> const secured_string *;
-  auto               remove(const secured_string &&key) -> size_t;
+  // outcome of storing a secret
+  enum class Result : uint8_t {
+    Added,
+    Replaced,
+    Exists,      // the key exists and replacing it was not asked for, nothing is changed
+    OverQuota,   // the secret does not fit into a quota even after evicting what it could
+    OutOfMemory, // locked memory ran out even after evicting what it could
+  };
+
+  // quotas bound bytes held by secrets, each charged for its key, its value and a fixed overhead
+  //  the namespace of a key is the part of it up to and including its first '/', keys without one share the
+  //   empty namespace
+  //  0 leaves a quota unlimited, which both are by default
+  void set_quotas(size_t global, size_t per_namespace);
+
+  // seal values into a cold tier in ordinary memory, see cold_tier.hh, keeping at most hot_bytes of values
+  //  unsealed in locked memory, return false if the tier cannot be set up
+  //  values are sealed as they are stored, and unsealed into locked memory as they are read, while the least
+  //   recently read ones are sealed again once hot values take more than hot_bytes
+  //  it shall be called before anything is stored
+  [[nodiscard]] auto enable_cold_tier(size_t hot_bytes) -> bool;
+
+  // pinned secrets are kept until removed, while evictable ones may be evicted and wiped to make room for
+  //  another secret once a quota or locked memory runs out, the least recently used first
+  //  evicted is invoked with the storage locked for each key right before it is evicted
+  //  nothing is allocated before the secret is stored, so a caller passing views of its buffers never runs
+  //   out of memory outside of the storage
+  auto add(
+    std::string_view                             key,
+    std::string_view                             value,
+    bool                                         evictable = false,
+    const std::function<void(std::string_view)> &evicted   = {}
+  ) -> Result;
+  // replace the value of an existing secret, or add it, along with whether it is evictable
+  auto update(
+    std::string_view                             key,
+    std::string_view                             value,
+    bool                                         evictable = false,
+    const std::function<void(std::string_view)> &evicted   = {}
+  ) -> Result;
+  // lookups take views of keys, e.g. over a receive buffer, and hash them once without copying them
+  //  a value found is passed to found with the storage locked, as it may be sealed again right afterwards,
+  //   and false is returned if there is none
+  [[nodiscard]] auto contains(std::string_view key) const -> bool;
+  auto               query(std::string_view key, const std::function<void(std::string_view)> &found) -> bool;
+  auto               remove(std::string_view key) -> size_t;
+  // remove a secret and pass its value to found with a single lookup
+  auto               take(std::string_view key, const std::function<void(std::string_view)> &found) -> bool;
+  [[nodiscard]] auto size() const -> size_t;
+
+  // keys are organized in namespaces by their prefixes, e.g. "tenant/service/key"
+  //  the callback is invoked with the storage locked, in lexicographical order of keys
+  void list_prefix(std::string_view prefix, const std::function<void(std::string_view)> &callback) const;
+  //  removed is invoked with the storage locked for each key right before it is removed
+  auto remove_prefix(std::string_view prefix, const std::function<void(std::string_view)> &removed = {})
+    -> size_t;
+
+  // visit every entry in the storage, the callback is invoked with the storage locked
+  void for_each(const std::function<void(const secured_string &, const secured_string &)> &callback) const;
+
+  // a change of the secret of key, with its value and whether it is evictable if it was stored, or without a
+  //  value if it was removed
+  using Journal =
+    std::function<void(std::string_view key, std::optional<std::string_view> value, bool evictable)>;
+  // invoke journal with the storage locked for every secret stored or removed, however it is, e.g. evicted or
+  //  consumed, so that changes of each key are journaled in the order they are made, e.g. to mirror them
+  //  it shall be set before anything is stored, and be quick as the partition of the key stays locked
+  void set_journal(Journal journal);
+  // where a replay left off, a cursor constructed anew starts at the first secret of the first partition
+  struct Cursor {
+    size_t         partition{0};
+    secured_string after;
+    bool           started{false};
+  };
+  // a secret held, passed to be taken in full, return false to stop before it
+  using Replay = std::function<bool(std::string_view key, std::string_view value, bool evictable)>;
+  // invoke take for every secret held from cursor on, in the order of keys within each partition, with only
+  //  the partition of the secret locked, until take stops, return whether any secret is left
+  //  replaying again with the same cursor carries on where it stopped, so secrets can be taken in chunks and
+  //   sent with the storage unlocked in between, while secrets stored meanwhile may or may not be seen
+  auto replay(Cursor &cursor, const Replay &take) const -> bool;
 };
 #endif
\ No newline at end of file
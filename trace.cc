@@ -0,0 +1,112 @@
+#include "trace.hh"
+#ifdef Tracing
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <print>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+struct Event {
+  const char *name;
+  uint64_t    begin;
+  uint64_t    end;
+  size_t      size;
+};
+
+// single producer ring buffer, older events are overwritten once it is full
+//  the dumper reads it concurrently, so an event being overwritten at that moment may appear torn
+struct Buffer {
+  static constexpr size_t Capacity = 1 << 16;
+
+  pid_t                       thread;
+  std::atomic<uint64_t>       next{0};
+  std::array<Event, Capacity> events;
+};
+
+std::mutex            mutex;
+std::vector<Buffer *> buffers;
+std::string           output;
+
+auto buffer() -> Buffer & {
+  // buffers are never freed, so a dump may still read those of threads that have exited
+  thread_local Buffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    buffer         = new Buffer();
+    buffer->thread = gettid();
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void dump() {
+  FILE *file = fopen(output.c_str(), "w");
+  if (file == nullptr) {
+    return;
+  }
+  const auto pid   = getpid();
+  bool       first = true;
+  std::print(file, "{{\"traceEvents\":[");
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto *buffer : buffers) {
+    const auto next  = buffer->next.load(std::memory_order_acquire);
+    const auto begin = next > Buffer::Capacity ? next - Buffer::Capacity : 0;
+    for (auto i = begin; i < next; i++) {
+      const auto &event = buffer->events[i % Buffer::Capacity];
+      std::print(
+        file,
+        "{}{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{},"
+        "\"args\":{{\"size\":{}}}}}",
+        first ? "" : ",\n",
+        event.name,
+        event.begin / 1e3,
+        (event.end - event.begin) / 1e3,
+        pid,
+        buffer->thread,
+        event.size
+      );
+      first = false;
+    }
+  }
+  std::println(file, "]}}");
+  fclose(file);
+}
+} // namespace
+
+auto Trace::now() -> uint64_t {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void Trace::record(const char *name, uint64_t begin, uint64_t end, size_t size) {
+  auto      &buffer                      = ::buffer();
+  const auto next                        = buffer.next.load(std::memory_order_relaxed);
+  buffer.events[next % Buffer::Capacity] = {name, begin, end, size};
+  buffer.next.store(next + 1, std::memory_order_release);
+}
+
+auto Trace::start(const char *path) -> bool {
+  output = path;
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR2);
+  if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+    return false;
+  }
+  std::thread([mask]() {
+    int signal = 0;
+    while (sigwait(&mask, &signal) == 0) {
+      dump();
+    }
+  }).detach();
+  return true;
+}
+#endif
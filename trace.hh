@@ -0,0 +1,40 @@
+#ifndef TRACE_HH_
+#define TRACE_HH_
+// low-overhead tracing of the request path, compiled in only if Tracing is defined
+//  each thread records into a ring buffer of its own, which is dumped as Chrome trace JSON on SIGUSR2
+//  only names, sizes and timings are ever recorded, never the content of keys or values
+#ifdef Tracing
+#include <cstddef>
+#include <cstdint>
+
+namespace Trace {
+// nanoseconds on the monotonic clock
+auto now() -> uint64_t;
+// name must be a string literal or otherwise live as long as the process
+void record(const char *name, uint64_t begin, uint64_t end, size_t size);
+// start a thread dumping all traces recorded so far into path whenever SIGUSR2 is received
+//  SIGUSR2 is blocked in the calling thread, so this shall be called before any other thread is created
+auto start(const char *path) -> bool;
+
+class Scope {
+public:
+  explicit Scope(const char *name, size_t size = 0) : name(name), size(size), begin(now()) {}
+  Scope(const Scope &)                     = delete;
+  auto operator=(const Scope &) -> Scope & = delete;
+  ~Scope() { record(this->name, this->begin, now(), this->size); }
+
+private:
+  const char *name;
+  size_t      size;
+  uint64_t    begin;
+};
+} // namespace Trace
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b)  TRACE_CONCATENATE_(a, b)
+// trace the enclosing scope with a name and optionally a size
+#define TRACE_SCOPE(...) Trace::Scope TRACE_CONCATENATE(trace_scope_, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SCOPE(...)
+#endif
+#endif